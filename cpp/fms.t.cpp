@@ -1,6 +1,11 @@
 // test.cpp - test C++ code
 #include <cassert>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <random>
 #include "fms_distribution_normal.h"
 #include "fms_distribution_double_exponential.h"
 #include "fms_distribution_discrete.h"
@@ -10,10 +15,19 @@
 #include "fms_black.h"
 #include "fms_bsm.h"
 #include "fms_pwflat.h"
+#include "fms_pwflat_view.h"
 #include "fms_fixed_income.h"
+#include "fms_instrument_book.h"
 #include "fms_bootstrap.h"
 #include "fms_carr_madan.h"
 #include "fms_binomial.h"
+#include "fms_trinomial.h"
+#include "fms_crank_nicolson.h"
+#include "fms_chebyshev.h"
+#include "fms_american.h"
+#include "fms_variance_swap.h"
+#include "fms_multi_curve.h"
+#include "fms_swap.h"
 
 using namespace fms;
 
@@ -58,14 +72,710 @@ int test_carr_madan()
 			double z = sqrt(s2) - s;
 			ensure(fabs(z) < 1e-4);
 		}
+		// value does not modify the payoff
+		for (size_t i = 0; i < n; ++i) {
+			ensure(fs[i] == -2 * log(ks[i] / f));
+		}
+
+		// precompiled replication gives the same value
+		for (double a : {-20., 50., 100., 100.5, 220.}) {
+			carr_madan::replication<> R(std::span<const double>(ks), std::span<const double>(fs), a);
+			double v = carr_madan::value(f, a, std::span(p), std::span(c), std::span(ks), f_);
+			double v_ = R.value(f, std::span<const double>(p), std::span<const double>(c));
+			ensure(fabs(v - v_) <= 1e-12 * fabs(v));
+		}
+
+		// blocked matrix of payoffs times snapshots
+		size_t r = 5, m = 11;
+		double a = 100;
+		std::vector<carr_madan::replication<>> R;
+		for (size_t i = 0; i < r; ++i) {
+			std::vector<double> g(n);
+			for (size_t l = 0; l < n; ++l) {
+				g[l] = i == 0 ? fs[l] : std::max(ks[l] - 80 - 10. * i, 0.);
+			}
+			R.emplace_back(std::span<const double>(ks), std::span<const double>(g), a);
+		}
+		std::vector<double> x(m), P(m * n), C(m * n), V(r * m);
+		for (size_t j = 0; j < m; ++j) {
+			x[j] = 95 + j;
+			for (size_t l = 0; l < n; ++l) {
+				P[j * n + l] = black::normal::put::value(x[j], s + 0.01 * j, ks[l]);
+				C[j * n + l] = black::normal::call::value(x[j], s + 0.01 * j, ks[l]);
+			}
+		}
+		carr_madan::value(std::span<const carr_madan::replication<>>(R), std::span<const double>(x), P.data(), C.data(), V.data());
+		for (size_t i = 0; i < r; ++i) {
+			for (size_t j = 0; j < m; ++j) {
+				double v = R[i].value(x[j], std::span<const double>(P.data() + j * n, n), std::span<const double>(C.data() + j * n, n));
+				ensure(fabs(V[i * m + j] - v) <= 1e-12 * (1 + fabs(v)));
+			}
+		}
+	}
+	{
+		// incremental updates agree with a full revaluation
+		std::vector<double> fs(n);
+		for (size_t i = 0; i < n; ++i) {
+			fs[i] = -2 * log(ks[i] / f);
+		}
+		std::vector<double> p_(p), c_(c);
+		carr_madan::incremental<> I(std::span<const double>(ks), std::span<const double>(fs), 100.,
+			std::span<const double>(p_), std::span<const double>(c_), 100);
+		double a = 100;
+		std::mt19937 gen(0);
+		std::uniform_int_distribution<size_t> strike(0, n - 1);
+		std::uniform_real_distribution<double> bump(-0.01, 0.01);
+		for (size_t j = 0; j < 1000; ++j) {
+			size_t i = strike(gen);
+			if (j % 3 == 0) {
+				p_[i] += bump(gen);
+				I.put(i, p_[i]);
+			}
+			else if (j % 3 == 1) {
+				c_[i] += bump(gen);
+				I.call(i, c_[i]);
+			}
+			else if (j % 50 == 2) {
+				a = 80 + 40 * (bump(gen) + 0.01) / 0.02;
+				I.separator(a);
+			}
+			double v = carr_madan::value(f, a, std::span(p_), std::span(c_), std::span(ks), std::span(fs));
+			ensure(fabs(I.value(f) - v) <= 1e-10);
+		}
+		// moves keep the running sums
+		double v = I.value(f);
+		carr_madan::incremental<> J(std::move(I));
+		ensure(J.value(f) == v);
+		I = std::move(J);
+		ensure(I.value(f) == v);
 	}
 
 	return 0;
 }
 int carr_madan_test = test_carr_madan();
 
-int main()
+// Seconds taken by f()
+template<class F>
+inline double elapsed(F f)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	f();
+	auto t1 = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double>(t1 - t0).count();
+}
+
+// Smallest doubling n with |v(n) - v_| < tol, time taken for that n, and the error.
+// If tol is not reached return n_max and its time and error.
+struct accuracy {
+	size_t n;
+	double t, e;
+};
+template<class V>
+inline accuracy time_to_accuracy(V v, double v_, double tol, size_t n_max)
+{
+	accuracy a{};
+	for (size_t n = 16; n <= n_max; n *= 2) {
+		double vn;
+		a.t = elapsed([&]() { vn = v(n); });
+		a.n = n;
+		a.e = fabs(vn - v_);
+		if (a.e < tol) {
+			break;
+		}
+	}
+
+	return a;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const accuracy& a)
+{
+	return os << "n = " << a.n << " " << a.t << "s error " << a.e;
+}
+
+int bench_trinomial()
+{
+	double f = 100, s = 0.2, tol = 1e-3;
+	size_t n_max = 1 << 12;
+	std::vector<double> v(2 * n_max + 1);
+
+	for (double k : {100., 80.}) {
+		auto put = [k](double x) { return std::max(k - x, 0.); };
+		auto bin = [&](size_t n) { return binomial::american::value(f, s, put, std::span(v.data(), n + 1)); };
+		auto tri = [&](size_t n) { return trinomial::american::value(f, s, put, std::span(v.data(), 2 * n + 1)); };
+		double v_ = black::normal::put::value(f, s, k); // no early exercise premium without carry
+
+		auto b = time_to_accuracy(bin, v_, tol, n_max);
+		auto t = time_to_accuracy(tri, v_, tol, n_max);
+		std::cout << "american put k = " << k << " tol = " << tol
+			<< ": binomial " << b << ", trinomial " << t << std::endl;
+	}
+
+	return 0;
+}
+
+int bench_crank_nicolson()
+{
+	double f = 100, s = 0.2, tol = 1e-5;
+	size_t n_max = 1 << 13;
+	std::vector<double> v(n_max + 1);
+
+	for (double k : {100., 80.}) {
+		auto put = [k](double x) { return std::max(k - x, 0.); };
+		auto bin = [&](size_t n) { return binomial::american::value(f, s, put, std::span(v.data(), n + 1)); };
+		auto cn = [&](size_t n) { return crank_nicolson::american::value(f, s, put, n + 1, n / 2); };
+		double v_ = black::normal::put::value(f, s, k); // no early exercise premium without carry
+
+		auto b = time_to_accuracy(bin, v_, tol, n_max / 4);
+		auto c = time_to_accuracy(cn, v_, tol, n_max);
+		std::cout << "american put k = " << k << " tol = " << tol
+			<< ": binomial " << b << ", crank nicolson M = " << c.n + 1 << " " << c.t << "s error " << c.e << std::endl;
+	}
+
+	return 0;
+}
+
+int bench_chebyshev()
+{
+	auto P = chebyshev::put::american(16, 12, -0.3, 0.3, 0.1, 0.4, 201, 100);
+	ensure(P.write("bench_chebyshev.bin"));
+	{
+		double tl = elapsed([]() { chebyshev::mapped M("bench_chebyshev.bin"); });
+		chebyshev::mapped M("bench_chebyshev.bin");
+		auto p = *M;
+
+		size_t n = 1'000'000;
+		double sum = 0;
+		double te = elapsed([&]() {
+			for (size_t i = 0; i < n; ++i) {
+				double k = 80 + 40. * i / n;
+				sum += chebyshev::put::value(p, 100., 0.2, k).value;
+			}
+		});
+		// strikes at one vol reuse the row sums
+		double ts = elapsed([&]() {
+			chebyshev::slice ps(p, 0.2);
+			for (size_t i = 0; i < n; ++i) {
+				double k = 80 + 40. * i / n;
+				sum += chebyshev::put::value(ps, 100., k).value;
+			}
+		});
+		std::cout << "chebyshev 16x12 sampled error = " << p.info().sampled_error << " load " << tl << "s"
+			<< ", put::value " << 1e9 * te / n << "ns, slice " << 1e9 * ts / n << "ns" << (sum > 0 ? "" : "!") << std::endl;
+	}
+	remove("bench_chebyshev.bin");
+
+	return 0;
+}
+
+int bench_carr_madan()
+{
+	// tangent of a 200 strike payoff at 10^5 sorted and shuffled forwards
+	size_t n = 200, m = 100'000;
+	std::vector<double> k(n), f(n);
+	for (size_t i = 0; i < n; ++i) {
+		k[i] = 1. + i;
+		f[i] = -2 * log(k[i] / 100);
+	}
+	std::vector<double> x(m), fx(m), mx(m);
+	for (size_t j = 0; j < m; ++j) {
+		x[j] = 50 + 100. * j / m;
+	}
+	std::vector<double> y(x);
+	std::shuffle(y.begin(), y.end(), std::mt19937(0));
+
+	double sum = 0;
+	for (const auto& [name, z] : { std::pair{"sorted", &x}, std::pair{"unsorted", &y} }) {
+		double t1 = elapsed([&]() {
+			for (size_t j = 0; j < m; ++j) {
+				sum += carr_madan::tangent((*z)[j], std::span(k), std::span(f)).first;
+			}
+		});
+		double tb = elapsed([&]() {
+			carr_madan::tangent(std::span<const double>(*z), std::span<const double>(k), std::span<const double>(f),
+				std::span<double>(fx), std::span<double>(mx));
+		});
+		sum += fx[m / 2];
+		std::cout << "carr_madan::tangent " << name << " n = " << n << " m = " << m
+			<< ": scalar " << 1e9 * t1 / m << "ns, batch " << 1e9 * tb / m << "ns" << (sum == sum ? "" : "!") << std::endl;
+	}
+
+	return 0;
+}
+
+int bench_variance_swap()
+{
+	// SPX sized chain: 40 expiries, 400 strikes on 4 grids
+	size_t m = 40, n = 400;
+	std::vector<double> k(4 * n), p(m * n), c(m * n), t(m), f(m);
+	for (size_t g = 0; g < 4; ++g) {
+		for (size_t i = 0; i < n; ++i) {
+			double lo = 4000 * (1 - 0.2 * (g + 1)), hi = 4000 * (1 + 0.3 * (g + 1));
+			k[g * n + i] = lo + (hi - lo) * i / (n - 1);
+		}
+	}
+	variance_swap::term_structure<> ts;
+	for (size_t j = 0; j < m; ++j) {
+		t[j] = (j + 1) / 12.;
+		f[j] = 4000 * (1 + 0.01 * t[j]);
+		double s = 0.2 * sqrt(t[j]);
+		const double* kj = k.data() + (j * 4 / m) * n;
+		for (size_t i = 0; i < n; ++i) {
+			p[j * n + i] = black::normal::put::value(f[j], s, kj[i]);
+			c[j * n + i] = black::normal::call::value(f[j], s, kj[i]);
+		}
+		ts.add({ t[j], f[j], std::span<const double>(kj, n),
+			std::span<const double>(p.data() + j * n, n), std::span<const double>(c.data() + j * n, n) });
+	}
+
+	size_t N = 1000;
+	double vix = 0;
+	double te = elapsed([&]() {
+		for (size_t i = 0; i < N; ++i) {
+			vix += 100 * sqrt(ts.compute().interpolate(30 / 365.));
+		}
+	});
+	std::cout << "variance_swap " << m << " expiries x " << n << " strikes, " << ts.grids_size() << " grids: "
+		<< 1e6 * te / N << "us, vix = " << vix / N << std::endl;
+
+	return 0;
+}
+
+int bench_pwflat()
+{
+	// daily discounts over 50 years from a 40 knot curve
+	std::vector<double> t, f;
+	for (double t_ : {1/12., 1/4., 1/2., 1., 2., 3., 5., 7., 10., 15., 20., 30., 40., 50.}) {
+		t.push_back(t_);
+		f.push_back(0.03 + 0.01 * log(1 + t_));
+	}
+	for (double t_ = 51; t.size() < 40; t_ += 1) {
+		t.push_back(t_);
+		f.push_back(0.05);
+	}
+	pwflat::curve<> c(t, f, 0.05);
+	size_t m = 50 * 365 + 12;
+	std::vector<double> u(m), v(m);
+	for (size_t j = 0; j < m; ++j) {
+		u[j] = (j + 1) / 365.25;
+	}
+
+	size_t N = 100;
+	double sum = 0;
+	double t1 = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			for (size_t j = 0; j < m; ++j) {
+				v[j] = pwflat::discount(u[j], c.size(), c.time(), c.forward(), c.extrapolate());
+			}
+			sum += v[m / 2];
+		}
+	});
+	double tp = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			for (size_t j = 0; j < m; ++j) {
+				v[j] = c.discount(u[j]);
+			}
+			sum += v[m / 2];
+		}
+	});
+	double tb = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			c.discount(std::span<const double>(u), std::span<double>(v));
+			sum += v[m / 2];
+		}
+	});
+	std::cout << "pwflat::discount " << m << " times, " << c.size() << " knots: linear " << 1e6 * t1 / N
+		<< "us, prefix " << 1e6 * tp / N << "us, batch " << 1e6 * tb / N << "us" << (sum > 0 ? "" : "!") << std::endl;
+
+	return 0;
+}
+
+int bench_bootstrap()
+{
+	// 4 deposits and 56 annual par swaps
+	auto is = bootstrap::deposits_swaps({ 1 / 12., 0.25, 0.5, 0.75 }, 0.03, 56, 0.03, 0.0002);
+	auto ps = bootstrap::pointers(is);
+
+	size_t N = 1000;
+	double sum = 0;
+	double tb = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			sum += bootstrap::build(ps).back().second;
+		}
+	});
+	std::cout << "bootstrap::build " << is.size() << " instruments: " << 1e6 * tb / N << "us" << (sum > 0 ? "" : "!") << std::endl;
+
+	return 0;
+}
+
+int bench_scenarios()
+{
+	// 10,000 scenarios of 4 deposits and 56 annual par swaps
+	auto is = bootstrap::deposits_swaps({ 1 / 12., 0.25, 0.5, 0.75 }, 0.03, 56, 0.03, 0.0002);
+	auto ps = bootstrap::pointers(is);
+	size_t n = is.size(), S = 10'000;
+	std::vector<double> p(S * n), t(n), f(S * n);
+	std::mt19937 gen(0);
+	std::normal_distribution<double> dp(0, 0.001);
+	for (auto& p_ : p) {
+		p_ = dp(gen);
+	}
+
+	unsigned hc = std::max(1u, std::thread::hardware_concurrency());
+	double t1 = 0;
+	for (size_t threads = 1; threads <= std::max(4u, hc); threads *= 2) {
+		double tt = elapsed([&]() { bootstrap::scenarios(n, ps.data(), S, p.data(), t.data(), f.data(), threads); });
+		if (threads == 1) {
+			t1 = tt;
+		}
+		std::cout << "bootstrap::scenarios " << S << " x " << n << " threads = " << threads << " (" << hc << " cores): "
+			<< tt << "s, speedup " << t1 / tt << std::endl;
+	}
+
+	return 0;
+}
+
+int bench_fit()
+{
+	// 40 quarterly FRAs and 60 annual par swaps from 11 to 70 years
+	using inst = fixed_income::instrument_value<>;
+	std::vector<inst> is;
+	for (int q = 0; q < 40; ++q) {
+		is.push_back(fixed_income::forward_rate_agreement<>(q / 4., (q + 1) / 4., 0.03 + 0.0001 * q));
+	}
+	for (int T = 11; T <= 70; ++T) {
+		is.push_back(bootstrap::par_swap(T, 0.034 + 0.0001 * T));
+	}
+	auto ps = bootstrap::pointers(is);
+
+	size_t N = 20;
+	double sum = 0;
+	double tb = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			sum += bootstrap::build(ps).back().second;
+		}
+	});
+	double tf = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			sum += bootstrap::fit(ps).back().second;
+		}
+	});
+	std::cout << "bootstrap " << is.size() << " instruments: build " << 1e6 * tb / N << "us, fit " << 1e6 * tf / N << "us"
+		<< (sum == sum ? "" : "!") << std::endl;
+
+	return 0;
+}
+
+int bench_multi_curve()
+{
+	// 30 annual OIS swaps on curve 0 and 30 quarterly 3 month swaps projected on curve 1
+	using inst = multi_curve::instrument<>;
+	std::vector<inst> is;
+	for (size_t d : {0, 1}) {
+		size_t q = d ? 4 : 1;
+		for (int T = 1; T <= 30; ++T) {
+			inst i{ {}, {}, {}, 1., 0, d, 0. };
+			for (int k = 1; k <= T; ++k) {
+				i.u.push_back(k);
+				i.c.push_back(-(0.03 + 0.002 * d + 0.0002 * T));
+			}
+			for (size_t k = 0; k <= T * q; ++k) {
+				i.t.push_back(double(k) / q);
+			}
+			is.push_back(i);
+		}
+	}
+	// single curve reference using the same number of fixed instruments
+	auto js = bootstrap::deposits_swaps({}, 0.03, 60, 0.03);
+	auto ps = bootstrap::pointers(js);
+
+	size_t N = 100;
+	double sum = 0;
+	double tm = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			sum += multi_curve::build(2, std::span<const inst>(is))[1].back().second;
+		}
+	});
+	double ts = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			sum += bootstrap::build(ps).back().second;
+		}
+	});
+	std::cout << "multi_curve::build 2 x 30 swaps " << 1e6 * tm / N << "us, single curve 60 instruments "
+		<< 1e6 * ts / N << "us" << (sum == sum ? "" : "!") << std::endl;
+
+	return 0;
+}
+
+int bench_portfolio()
 {
+	// 50,000 quarterly fixed legs on a daily grid, about a million cash flows
+	using inst = fixed_income::instrument_value<>;
+	std::mt19937 gen(0);
+	std::uniform_int_distribution<int> start(0, 365), years(1, 10);
+	std::vector<inst> is;
+	size_t n = 50'000, m = 0;
+	for (size_t j = 0; j < n; ++j) {
+		inst i;
+		int s = start(gen), q = 4 * years(gen);
+		for (int k = 0; k <= q; ++k) {
+			i.extend((s + 91 * k) / 365., k == 0 ? -1 : k < q ? 0.01 : 1.01);
+		}
+		m += i.size();
+		is.push_back(std::move(i));
+	}
+	auto ps = bootstrap::pointers(is);
+	std::vector<double> w(n, 1);
+
+	size_t N = 10;
+	double sum = 0;
+	double tm = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			std::map<double, double> wi;
+			for (size_t j = 0; j < n; ++j) {
+				for (size_t l = 0; l < ps[j]->size(); ++l) {
+					wi[ps[j]->time()[l]] += w[j] * ps[j]->cash()[l];
+				}
+			}
+			sum += wi.size();
+		}
+	});
+	double th = elapsed([&]() {
+		for (size_t k = 0; k < N; ++k) {
+			sum += fixed_income::portfolio(n, w.data(), ps.data()).size();
+		}
+	});
+	std::cout << "fixed_income::portfolio " << n << " instruments, " << m << " cash flows: map " << 1e3 * tm / N
+		<< "ms, merge " << 1e3 * th / N << "ms" << (sum > 0 ? "" : "!") << std::endl;
+
+	return 0;
+}
+
+int bench_instrument_book()
+{
+	// 100,000 semiannual par bonds up to 30 years
+	size_t n = 100'000;
+	std::mt19937 gen(0);
+	std::uniform_int_distribution<int> years(1, 30);
+	std::vector<int> T(n);
+	size_t m = 0;
+	for (auto& T_ : T) {
+		T_ = years(gen);
+		m += 2 * T_ + 1;
+	}
+	double t[] = { 1, 2, 5, 10, 30 }, f[] = { 0.03, 0.032, 0.035, 0.04, 0.042 };
+	pwflat::curve<> g(5, t, f, 0.042);
+	std::vector<double> u, c;
+	auto bond = [&](int T_) {
+		u.assign(1, 0);
+		c.assign(1, -1);
+		for (int k = 1; k <= 2 * T_; ++k) {
+			u.push_back(k / 2.);
+			c.push_back(k < 2 * T_ ? 0.02 : 1.02);
+		}
+	};
+
+	double sum = 0;
+	std::vector<fixed_income::instrument_value<>> is;
+	double tv = elapsed([&]() {
+		is.reserve(n);
+		for (int T_ : T) {
+			bond(T_);
+			is.emplace_back(u.size(), u.data(), c.data());
+		}
+	});
+	auto pb_ = std::make_unique<fixed_income::instrument_book<>>(n, m);
+	auto& b = *pb_;
+	double tb = elapsed([&]() {
+		for (int T_ : T) {
+			bond(T_);
+			b.add(u.size(), u.data(), c.data());
+		}
+	});
+	auto ps = bootstrap::pointers(is);
+	std::vector<double> pv(n);
+	double pv_ = elapsed([&]() {
+		for (size_t j = 0; j < n; ++j) {
+			const auto& i = *ps[j];
+			pv[j] = bootstrap::present_value(i.size(), i.time(), i.cash(), g.size(), g.time(), g.forward(), g.extrapolate(), g.prefix());
+		}
+	});
+	sum += pv[n / 2];
+	double pb = elapsed([&]() { present_value(b, g, std::span<double>(pv)); });
+	sum += pv[n / 2];
+	std::unique_ptr<fixed_income::schedule<>> S;
+	double ts = elapsed([&]() { S = std::make_unique<fixed_income::schedule<>>(b); });
+	double pk = elapsed([&]() { sum += present_value(b, *S, g, std::span<double>(pv)); });
+	std::cout << "instrument_book " << S->size() << " distinct times: schedule " << 1e3 * ts << "ms, pv " << 1e3 * pk << "ms" << std::endl;
+	double fv = elapsed([&]() { is = {}; });
+	double fb = elapsed([&]() { pb_.reset(); });
+	std::cout << "instrument_book " << n << " instruments, " << m << " cash flows: vectors build " << 1e3 * tv
+		<< "ms, pv " << 1e3 * pv_ << "ms, free " << 1e3 * fv << "ms; book build " << 1e3 * tb
+		<< "ms, pv " << 1e3 * pb << "ms, free " << 1e3 * fb << "ms" << (sum == sum ? "" : "!") << std::endl;
+
+	return 0;
+}
+
+int bench_swap()
+{
+	// par rates of semiannual swaps from 1 to 50 years
+	std::vector<double> t, f;
+	for (double t_ : {1/12., 1/4., 1/2., 1., 2., 3., 5., 7., 10., 15., 20., 30., 40., 50.}) {
+		t.push_back(t_);
+		f.push_back(0.03 + 0.01 * log(1 + t_));
+	}
+	pwflat::curve<> g(t, f, 0.05);
+	size_t N = 1000;
+	double p[50], sum = 0;
+	double ti = elapsed([&]() {
+		for (size_t n = 0; n < N; ++n) {
+			for (int T = 1; T <= 50; ++T) {
+				fixed_income::instrument_value<> i;
+				for (int k = 1; k <= 2 * T; ++k) {
+					i.extend(k / 2., 0.5);
+				}
+				double a = bootstrap::present_value(i.size(), i.time(), i.cash(), g.size(), g.time(), g.forward(), g.extrapolate());
+				p[T - 1] = (1 - g.discount(T)) / a;
+			}
+			sum += p[49];
+		}
+	});
+	double ts = elapsed([&]() {
+		for (size_t n = 0; n < N; ++n) {
+			swap::sweep<> s(0, 2, 100, g);
+			s.par(2, std::span<double>(p));
+			sum += p[49];
+		}
+	});
+	std::cout << "swap par rates 50 tenors: instruments " << 1e6 * ti / N << "us, sweep " << 1e6 * ts / N << "us"
+		<< (sum > 0 ? "" : "!") << std::endl;
+
+	return 0;
+}
+
+int bench_pwflat_search()
+{
+	// random lookups on curves with 10, 100, and 10,000 knots
+	std::mt19937 gen(0);
+	size_t m = 1'000'000;
+	for (size_t n : {10, 100, 10'000}) {
+		std::vector<double> t(n), f(n);
+		for (size_t i = 0; i < n; ++i) {
+			t[i] = 50. * (i + 1) / n;
+			f[i] = 0.03 + 0.01 * log(1 + t[i]);
+		}
+		pwflat::curve<> c(t, f, 0.05);
+		std::uniform_real_distribution<double> du(0, 55);
+		std::vector<double> u(m);
+		for (auto& u_ : u) {
+			u_ = du(gen);
+		}
+
+		double sum = 0;
+		double ts = elapsed([&]() {
+			for (double u_ : u) {
+				size_t i = std::upper_bound(t.begin(), t.end(), u_) - t.begin();
+				sum += (i ? c.prefix()[i - 1] : 0) + (i == n ? 0.05 : f[i]) * (u_ - (i ? t[i - 1] : 0));
+			}
+		});
+		double tb = elapsed([&]() {
+			for (double u_ : u) {
+				sum += c.integral(u_);
+			}
+		});
+		std::cout << "pwflat::integral random " << n << " knots: std::upper_bound " << 1e9 * ts / m
+			<< "ns, curve " << 1e9 * tb / m << "ns" << (sum > 0 ? "" : "!") << std::endl;
+	}
+
+	return 0;
+}
+
+int bench_pwflat_view()
+{
+	// 10,000 parallel shift scenarios of a 40 knot curve discounting 100 semiannual dates
+	std::vector<double> t, f;
+	for (size_t i = 0; i < 40; ++i) {
+		t.push_back(0.25 * (i + 1) * (i + 1) / 16);
+		f.push_back(0.03 + 0.01 * log(1 + t.back()));
+	}
+	pwflat::curve<> c(t, f, 0.05);
+	std::vector<double> u(100), D(100);
+	for (size_t j = 0; j < 100; ++j) {
+		u[j] = (j + 1) / 2.;
+	}
+	size_t S = 10'000;
+	double sum = 0;
+	double tc = elapsed([&]() {
+		for (size_t s = 0; s < S; ++s) {
+			double h = 1e-6 * s;
+			std::vector<double> g(f);
+			for (auto& g_ : g) {
+				g_ += h;
+			}
+			pwflat::curve<> d(t, g, 0.05 + h);
+			d.discount(std::span<const double>(u), std::span<double>(D));
+			sum += D[99];
+		}
+	});
+	double tv = elapsed([&]() {
+		for (size_t s = 0; s < S; ++s) {
+			pwflat::view v(c, pwflat::parallel<>{ 1e-6 * s });
+			v.discount(std::span<const double>(u), std::span<double>(D));
+			sum += D[99];
+		}
+	});
+	std::cout << "pwflat::view " << S << " parallel scenarios: copy " << 1e3 * tc << "ms, view " << 1e3 * tv << "ms"
+		<< (sum > 0 ? "" : "!") << std::endl;
+
+	return 0;
+}
+
+int bench_pwflat_storage()
+{
+	// 1,000,000 scenario curves of 20 knots generated and used, then 100,000 kept
+	size_t n = 20;
+	std::vector<double> t(n), f(n), g(n);
+	for (size_t i = 0; i < n; ++i) {
+		t[i] = 0.5 * (i + 1);
+		f[i] = 0.03 + 0.001 * i;
+	}
+	auto generate = [&](auto c, size_t S, bool keep) {
+		using curve = decltype(c);
+		std::vector<curve> cs;
+		if (keep) {
+			cs.reserve(S);
+		}
+		double sum = 0;
+		double te = elapsed([&]() {
+			for (size_t s = 0; s < S; ++s) {
+				for (size_t i = 0; i < n; ++i) {
+					g[i] = f[i] + 1e-7 * s;
+				}
+				curve c_(n, t.data(), g.data(), 0.05);
+				sum += c_.integral(5);
+				if (keep) {
+					cs.push_back(std::move(c_));
+				}
+			}
+		});
+
+		return sum > 0 ? te : -te;
+	};
+	for (bool keep : {false, true}) {
+		size_t S = keep ? 100'000 : 1'000'000;
+		double tv = generate(pwflat::curve<>{}, S, keep);
+		double ts = generate(pwflat::curve<double, double, 24>{}, S, keep);
+		std::cout << "pwflat::curve " << S << " scenario curves of " << n << " knots" << (keep ? " kept" : "")
+			<< ": std::vector " << 1e3 * tv << "ms, inline 24 " << 1e3 * ts << "ms" << std::endl;
+	}
+
+	return 0;
+}
+
+// Run the tests, then the benchmarks if called with --bench.
+int main(int ac, const char* av[])
+{
+	bool bench = ac > 1 and 0 == strcmp(av[1], "--bench");
 	double x = machine_epsilon();
 	ensure(x != 0);
 	ensure(1 + x == 1);
@@ -78,12 +788,57 @@ int main()
 		black::normal::put::test();
 		bachelier::put::test();
 		bsm::test_Dfs();
+		fixed_income::portfolio_test();
+		fixed_income::instrument_book_test();
+		pwflat::test_prefix();
+		pwflat::test_batch();
+		pwflat::test_bound();
+		pwflat::test_view();
+		small_vector<double, 4>::test();
+		pwflat::test_storage();
+		bootstrap::extend_test();
+		bootstrap::build_test();
+		bootstrap::live_test();
+		bootstrap::jacobian_test();
+		bootstrap::scenarios_test();
+		bootstrap::fit_test();
+		multi_curve::test();
+		swap::test();
 		carr_madan::test_index();
 		carr_madan::test_tangent();
 		carr_madan::test_fit<double>();
 		binomial::fill_test();
+		binomial::fillp_test();
 		binomial::european::test();
+		binomial::european::testp();
 		binomial::american::test();
+		binomial::american::testp();
+		binomial::bermudan::test();
+		trinomial::fill_test();
+		trinomial::european::test();
+		trinomial::american::test();
+		crank_nicolson::test_grid();
+		chebyshev::test();
+		american::test();
+		variance_swap::test();
+		if (bench) {
+			bench_portfolio();
+			bench_instrument_book();
+			bench_pwflat();
+			bench_pwflat_search();
+			bench_pwflat_storage();
+			bench_pwflat_view();
+			bench_fit();
+			bench_multi_curve();
+			bench_swap();
+			bench_scenarios();
+			bench_bootstrap();
+			bench_carr_madan();
+			bench_trinomial();
+			bench_crank_nicolson();
+			bench_chebyshev();
+			bench_variance_swap();
+		}
 	}
 	catch (const std::exception& ex) {
 		std::cerr << ex.what() << std::endl;;
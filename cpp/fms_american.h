@@ -0,0 +1,233 @@
+// fms_american.h - Implied vol of American options priced by binomial::american::value
+// Warm start with the European implied vol, correct for the early exercise premium
+// using the lattice vega, then take Newton steps using the vega accumulated in the same lattice pass.
+#pragma once
+#include "ensure.h"
+#include "fms_binomial.h"
+#include "fms_black_normal.h"
+#include <cmath>
+#include <numbers>
+#include <span>
+#include <tuple>
+
+namespace fms::american {
+
+	template<class X>
+	constexpr X NaN = std::numeric_limits<X>::quiet_NaN();
+
+	// Value and dv/ds of max_tau E[max{w(F_tau - k), 0}], w = 1 for calls and -1 for puts.
+	// Same lattice as binomial::american::value using n = v.size() - 1 steps and dv.size() = v.size().
+	// dF_k(j)/ds = F_k(j) ((2j - k) - k tanh(s/sqrt(n)))/sqrt(n).
+	template<class X = double>
+	inline std::pair<X, X> value_vega(X f, X s, X k, X w, std::span<X> v, std::span<X> dv)
+	{
+		ensure(v.size() > 0 and v.size() == dv.size());
+		size_t n = binomial::fill(f, s, v);
+		if (n == 0) {
+			return { std::max(w * (f - k), X(0)), X(0) };
+		}
+
+		X rn = sqrt(X(n));
+		X sn = s / rn;
+		X tn = tanh(sn);
+		X u = exp(2 * sn);
+		for (size_t j = 0; j <= n; ++j) {
+			X F = v[j];
+			X dF = F * ((2. * j - X(n)) - n * tn) / rn;
+			bool ex = w * (F - k) > 0;
+			v[j] = ex ? w * (F - k) : 0;
+			dv[j] = ex ? w * dF : 0;
+		}
+
+		// binomial::american::step compares with phi(F_m(j)) where m = v.size() - 2 after the step
+		for (size_t m = n - 1; m + 1 > 0; --m) {
+			X F = binomial::forward(f, s, n, m, 0);
+			for (size_t j = 0; j <= m; ++j) {
+				v[j] = (v[j] + v[j + 1]) / 2;
+				dv[j] = (dv[j] + dv[j + 1]) / 2;
+				X vj = std::max(w * (F - k), X(0));
+				if (vj > v[j]) {
+					v[j] = vj;
+					dv[j] = w * F * ((2. * j - X(m)) - m * tn) / rn;
+				}
+				F *= u;
+			}
+		}
+
+		return { v[0], dv[0] };
+	}
+
+	// Find s with p = value of American option. Return NaN if no solution.
+	// Stop when the price is within eps or the Newton step is less than tol.
+	// Uses at most iter lattice evaluations, typically 3.
+	template<class X = double>
+	inline X implied(X f, X p, X k, X w, std::span<X> v, std::span<X> dv,
+		X eps = 1e-8, size_t iter = 10, X tol = 1e-4)
+	{
+		auto black = [w](X f_, X s_, X k_) {
+			return w > 0 ? black::normal::call::value(f_, s_, k_) : black::normal::put::value(f_, s_, k_);
+		};
+		auto black_implied = [w](X f_, X p_, X k_, X s_) {
+			return w > 0 ? black::normal::call::implied(f_, p_, k_, s_) : black::normal::put::implied(f_, p_, k_, s_);
+		};
+		// dblack/ds = f phi(z - s), z = moneyness
+		auto black_vega = [](X f_, X s_, X k_) {
+			X d = black::normal::moneyness(f_, s_, k_) - s_;
+			return f_ * exp(-d * d / 2) / sqrt(2 * std::numbers::pi_v<X>);
+		};
+
+		ensure(iter > 0);
+		if (f <= 0 or k <= 0 or p <= std::max(w * (f - k), X(0))) {
+			return NaN<X>;
+		}
+
+		// European implied vol of the American price overstates s by the early exercise premium.
+		X s = black_implied(f, p, k, X(0.2));
+		if (!(s > 0)) {
+			return NaN<X>;
+		}
+
+		auto [a, vega] = value_vega(f, s, k, w, v, dv);
+		--iter;
+		if (fabs(a - p) <= eps) {
+			return s;
+		}
+		// Early exercise premium e(s) = a(s) - black(s) is approximately e(s0) + (vega - black vega)(s - s0).
+		// Solve black(s) + e(s) = p using closed form Black values.
+		X s0 = s;
+		X e = a - black(f, s0, k);
+		X de = vega - black_vega(f, s0, k);
+		for (int i = 0; i < 20; ++i) {
+			X g = black(f, s, k) + e + de * (s - s0) - p;
+			X dg = black_vega(f, s, k) + de;
+			if (!(dg > 0)) {
+				s = NaN<X>;
+				break;
+			}
+			X ds = g / dg;
+			s = s - ds > 0 ? s - ds : s / 2;
+			if (fabs(ds) < 1e-12) {
+				break;
+			}
+		}
+		if (!(s > 0)) {
+			// Newton step from the warm start
+			s = vega > 0 ? s0 - (a - p) / vega : NaN<X>;
+		}
+		if (!(s > 0)) {
+			return NaN<X>;
+		}
+
+		while (iter--) {
+			std::tie(a, vega) = value_vega(f, s, k, w, v, dv);
+			if (fabs(a - p) <= eps) {
+				return s;
+			}
+			if (!(vega > 0)) {
+				return NaN<X>;
+			}
+			X ds = (a - p) / vega;
+			if (fabs(ds) < tol) {
+				// Newton error is O(ds^2)
+				return s - ds;
+			}
+			s = s - ds > 0 ? s - ds : s / 2;
+		}
+
+		return NaN<X>;
+	}
+
+	namespace put {
+
+		template<class X = double>
+		inline X implied(X f, X p, X k, std::span<X> v, std::span<X> dv, X eps = 1e-8, size_t iter = 10, X tol = 1e-4)
+		{
+			return american::implied(f, p, k, X(-1), v, dv, eps, iter, tol);
+		}
+
+	} // namespace put
+
+	namespace call {
+
+		template<class X = double>
+		inline X implied(X f, X c, X k, std::span<X> v, std::span<X> dv, X eps = 1e-8, size_t iter = 10, X tol = 1e-4)
+		{
+			return american::implied(f, c, k, X(1), v, dv, eps, iter, tol);
+		}
+
+	} // namespace call
+
+	// Implied vols of a chain of quotes p[i] at strikes |k[i]|, calls for k[i] > 0 and puts for k[i] < 0.
+	// The lattice buffers are reused for every quote. Return the number of quotes solved.
+	template<class X = double>
+	inline size_t implied(X f, std::span<const X> k, std::span<const X> p, std::span<X> s,
+		std::span<X> v, std::span<X> dv, X eps = 1e-8, size_t iter = 10, X tol = 1e-4)
+	{
+		ensure(k.size() == p.size() and k.size() == s.size());
+
+		size_t n = 0;
+		for (size_t i = 0; i < k.size(); ++i) {
+			s[i] = implied(f, p[i], fabs(k[i]), k[i] > 0 ? X(1) : X(-1), v, dv, eps, iter, tol);
+			if (s[i] == s[i]) {
+				++n;
+			}
+		}
+
+		return n;
+	}
+
+#ifdef _DEBUG
+	inline int test()
+	{
+		double f = 100, s = 0.2;
+		constexpr size_t n = 200;
+		double v[n + 1], dv[n + 1];
+		{
+			// same value as binomial::american::value and vega matches a finite difference
+			for (double k : {80., 100., 120.}) {
+				auto put = [k](double x) { return std::max(k - x, 0.); };
+				auto [a, vega] = value_vega(f, s, k, -1., std::span(v, n + 1), std::span(dv, n + 1));
+				double b = binomial::american::value(f, s, put, std::span(v, n + 1));
+				ensure(fabs(a - b) < 1e-10);
+				double h = 1e-5;
+				double up = binomial::american::value(f, s + h, put, std::span(v, n + 1));
+				double dn = binomial::american::value(f, s - h, put, std::span(v, n + 1));
+				ensure(fabs(vega - (up - dn) / (2 * h)) < 1e-3);
+			}
+		}
+		{
+			for (double k : {80., 100., 120.}) {
+				auto put = [k](double x) { return std::max(k - x, 0.); };
+				double p = binomial::american::value(f, s, put, std::span(v, n + 1));
+				double s_ = put::implied(f, p, k, std::span(v, n + 1), std::span(dv, n + 1));
+				ensure(fabs(s_ - s) < 1e-8);
+				// at most 3 lattice evaluations
+				s_ = put::implied(f, p, k, std::span(v, n + 1), std::span(dv, n + 1), 1e-8, 3);
+				ensure(fabs(s_ - s) < 1e-8);
+
+				auto call = [k](double x) { return std::max(x - k, 0.); };
+				double c = binomial::american::value(f, s, call, std::span(v, n + 1));
+				s_ = call::implied(f, c, k, std::span(v, n + 1), std::span(dv, n + 1));
+				ensure(fabs(s_ - s) < 1e-8);
+			}
+		}
+		{
+			double k[] = { -80, -90, -100, 100, 110, 120 };
+			double p[6], s_[6];
+			for (size_t i = 0; i < 6; ++i) {
+				double k_ = fabs(k[i]);
+				auto phi = [k_, w = k[i] > 0 ? 1. : -1.](double x) { return std::max(w * (x - k_), 0.); };
+				p[i] = binomial::american::value(f, s + 0.01 * i, phi, std::span(v, n + 1));
+			}
+			size_t m = implied(f, std::span<const double>(k), std::span<const double>(p), std::span(s_, 6), std::span(v, n + 1), std::span(dv, n + 1));
+			ensure(m == 6);
+			for (size_t i = 0; i < 6; ++i) {
+				ensure(fabs(s_[i] - (s + 0.01 * i)) < 1e-7);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fms::american
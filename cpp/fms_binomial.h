@@ -90,23 +90,91 @@ namespace fms::binomial {
 	// Skewed Random Walk
 	// Let P(X_j = 1) = p, P(X_j = -1) = 1 - p be independent and Wp_n = a_n sum_j X_j - b_n
 	// Note E[X_j] = 2p - 1 and Var(X_j) = 4p(1 - p).
-	// Define Fp_n = f exp(s Wp_n)/cp_n where cp_n = E[s Wp_n].
-	// !!! Find a_n and b_n such that E[Fp_n] = f and Var(log Fp_n) = s^2
+	// Define Fp_n = f exp(Wp_n).
+	// Var(log Fp_n) = a_n^2 n 4p(1 - p) = s^2 so a_n = s/sqrt(4 n p(1 - p)).
+	// E[exp(a_n X_j)] = p e^a_n + (1 - p) e^-a_n = cp_n so b_n = n log cp_n gives E[Fp_n] = f.
+	// If p = 1/2 then a_n = s/sqrt(n), cp_n = cosh(s/sqrt(n)) and Fp_n = F_n.
+
+	// a_n and cp_n
+	template<class X>
+	constexpr std::pair<X, X> skew(X s, X p, size_t n)
+	{
+		ensure(p > 0 and 1 - p > 0);
+		ensure(n > 0);
+
+		X an = s / sqrt(4 * n * p * (1 - p));
+		X cn = p * exp(an) + (1 - p) * exp(-an);
+
+		return { an, cn };
+	}
+
 	// Fp_k(j)
 	template<class X>
 	constexpr X forwardp(X f, X s, X p, size_t n, size_t k, size_t j)
 	{
 		ensure(p > 0 and 1 - p > 0);
+		ensure(n >= k and k >= j);
 
-		return 0; //!!! Implement
+		if (n == 0) {
+			return f;
+		}
+
+		auto [an, cn] = skew(s, p, n);
+
+		return f * exp(an * (2.0 * j - k)) / pow(cn, k);
 	}
 
 	// Populate Fp_n(j) at step n = F.size() - 1
 	template<class X, size_t N>
 	constexpr size_t fillp(X f, X s, X p, std::span<X, N> F)
 	{
-		return 0; // !!! Implement
+		ensure(F.size() > 0);
+		size_t n = F.size() - 1;
+
+		if (n == 0) {
+			F[0] = f;
+		}
+		else {
+			for (size_t j = 0; j <= n; ++j) {
+				F[j] = forwardp(f, s, p, n, n, j);
+			}
+		}
+
+		return n;
 	}
+#ifdef _DEBUG
+	static int fillp_test()
+	{
+		double f = 100, s = 0.1;
+		double F[10], G[10];
+		for (size_t n : {0, 1, 2, 9}) {
+			fill(f, s, std::span(F, n + 1));
+			fillp(f, s, 0.5, std::span(G, n + 1));
+			for (size_t j = 0; j <= n; ++j) {
+				ensure(fabs(F[j] - G[j]) <= 1e-13 * f);
+			}
+		}
+		{
+			size_t n = 9;
+			for (double p : {0.1, 0.3, 0.7}) {
+				fillp(f, s, p, std::span(F, n + 1));
+				// E[Fp_n] = f and Var(log Fp_n) = s^2
+				double E = 0, E1 = 0, E2 = 0;
+				for (size_t j = 0; j <= n; ++j) {
+					// P(j up moves) = C(n, j) p^j (1 - p)^(n - j)
+					double P = tgamma(n + 1.) / (tgamma(j + 1.) * tgamma(n - j + 1.)) * pow(p, j) * pow(1 - p, n - j);
+					E += P * F[j];
+					E1 += P * log(F[j]);
+					E2 += P * log(F[j]) * log(F[j]);
+				}
+				ensure(fabs(E - f) <= 1e-12 * f);
+				ensure(fabs(E2 - E1 * E1 - s * s) <= 1e-12);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
 
 	namespace european {
 
@@ -122,11 +190,15 @@ namespace fms::binomial {
 		}
 
 		// { v[0], ..., v[n-1] } => { (v[0] (1 - p) + v[1] p, ..., v[n-2] (1 - p) + v[n-1] p }
-		// !!! Implement stepp(X p, std::span<X, N> v)
+		// v[i] (1 - p) + v[i + 1] p = v[i] + p (v[i + 1] - v[i]) is one multiply-add per node.
 		template<class X, size_t N>
 		constexpr auto stepp(X p, std::span<X, N> v)
 		{
-			return v; // !!! Implement
+			for (size_t i = 0; i < v.size() - 1; ++i) {
+				v[i] += p * (v[i + 1] - v[i]);
+			}
+
+			return std::span<X>(v.begin(), v.size() - 1);
 		}
 
 		template<class Phi, class X, size_t N>
@@ -143,7 +215,7 @@ namespace fms::binomial {
 			return v[0];
 		}
 
-		// !!! Implement XLL.BINOMIAL.EUROPEANP in xll_binomial.cpp
+		// E[phi(Fp_n)] using P(X_j = 1) = p
 		template<class Phi, class X, size_t N>
 		X valuep(X f, X s, X p, Phi phi, std::span<X, N> v)
 		{
@@ -152,7 +224,7 @@ namespace fms::binomial {
 			std::transform(v.begin(), v.end(), v.begin(), phi);
 			// Expected value
 			while (v.size() > 1) {
-				v = stepp(v);
+				v = stepp(p, v);
 			}
 
 			return v[0];
@@ -185,6 +257,28 @@ namespace fms::binomial {
 
 			return 0;
 		}
+
+		inline int testp()
+		{
+			double f = 100;
+			double s = 0.1;
+			double k = 100;
+			double v[101];
+			auto put = [=](double x) { return std::max(k - x, 0.); };
+			{
+				double v0 = valuep(f, s, 0.5, put, std::span(v, 101));
+				double v1 = value(f, s, put, std::span(v, 101));
+				ensure(fabs(v0 - v1) < 1e-10);
+			}
+			for (double p : {0.2, 0.4, 0.6, 0.8}) {
+				double v0 = valuep(f, s, p, [](double x) { return x; }, std::span(v, 101));
+				ensure(fabs(v0 - f) < 1e-11);
+				v0 = valuep(f, s, p, put, std::span(v, 101));
+				ensure(fabs(v0 - 3.99) < 3e-2);
+			}
+
+			return 0;
+		}
 #endif // _DEBUG
 
 	}
@@ -194,9 +288,9 @@ namespace fms::binomial {
 		template<class Phi, class X = double>
 		constexpr auto step(X f, X s, size_t n, Phi phi, std::span<X> v)
 		{
-			size_t k = v.size() - 1;
+			size_t k = v.size() - 2; // level after the step
 
-			for (size_t j = 0; j < k; ++j) {
+			for (size_t j = 0; j <= k; ++j) {
 				v[j] = (v[j] + v[j + 1]) / 2;
 				X vj = phi(forward(f, s, n, k, j));
 				if (vj > v[j]) {
@@ -222,6 +316,42 @@ namespace fms::binomial {
 			return v[0];
 		}
 
+		// Skewed step using Fp_k(j + 1) = Fp_k(j) exp(2 a_n) instead of forwardp at every node.
+		template<class Phi, class X = double>
+		constexpr auto stepp(X f, X s, X p, size_t n, Phi phi, std::span<X> v)
+		{
+			size_t k = v.size() - 2; // level after the step
+			auto [an, cn] = skew(s, p, n);
+			X u = exp(2 * an);
+			X F = f * exp(-an * k) / pow(cn, k); // Fp_k(0)
+
+			for (size_t j = 0; j <= k; ++j) {
+				v[j] += p * (v[j + 1] - v[j]);
+				X vj = phi(F);
+				if (vj > v[j]) {
+					v[j] = vj;
+				}
+				F *= u;
+			}
+
+			return std::span<X>(v.begin(), v.size() - 1);
+		}
+
+		// Return max_tau E[phi(Fp_tau)] using P(X_j = 1) = p
+		template<class Phi, class X = double>
+		inline X valuep(X f, X s, X p, Phi phi, std::span<X> v)
+		{
+			size_t n = fillp(f, s, p, v);
+			// Apply phi to F
+			std::transform(v.begin(), v.end(), v.begin(), phi);
+			// Expected value
+			while (v.size() > 1) {
+				v = stepp(f, s, p, n, phi, v);
+			}
+
+			return v[0];
+		}
+
 #ifdef _DEBUG
 		inline int test()
 		{
@@ -242,13 +372,38 @@ namespace fms::binomial {
 				auto c = [=](double x) { return std::max(x - k, 0.); };
 				double va = value(f, s, c, std::span(v, 101));
 				double ve = european::value(f, s, c, std::span(v, 101));
-				ensure(va == ve);
+				ensure(fabs(va - ve) < 1e-12);
 			}
 			{
+				// no carry so early exercise of a put is never optimal
 				auto p = [=](double x) { return std::max(k - x, 0.); };
 				double va = value(f, s, p, std::span(v, 101));
 				double ve = european::value(f, s, p, std::span(v, 101));
-				ensure(va > ve);
+				ensure(fabs(va - ve) < 1e-12);
+			}
+
+			return 0;
+		}
+
+		inline int testp()
+		{
+			double f = 100, s = 0.1, k = 100;
+			double v[101];
+			auto c = [=](double x) { return std::max(x - k, 0.); };
+			auto p = [=](double x) { return std::max(k - x, 0.); };
+			{
+				double va = valuep(f, s, 0.5, p, std::span(v, 101));
+				double vb = value(f, s, p, std::span(v, 101));
+				ensure(fabs(va - vb) < 1e-10);
+			}
+			for (double q : {0.3, 0.7}) {
+				double va = valuep(f, s, q, c, std::span(v, 101));
+				double ve = european::valuep(f, s, q, c, std::span(v, 101));
+				ensure(fabs(va - ve) < 1e-12);
+
+				va = valuep(f, s, q, p, std::span(v, 101));
+				ve = european::valuep(f, s, q, p, std::span(v, 101));
+				ensure(fabs(va - ve) < 1e-12);
 			}
 
 			return 0;
@@ -256,4 +411,88 @@ namespace fms::binomial {
 #endif // _DEBUG
 
 	} // namespace american
+
+	namespace bermudan {
+
+		// Lattice level k = round(t n) of exercise time t in [0, 1] as a fraction of expiration.
+		template<class X>
+		constexpr size_t level(X t, size_t n)
+		{
+			ensure(0 <= t and t <= 1);
+
+			return static_cast<size_t>(std::lround(t * n));
+		}
+
+		// Return max_tau E[phi(F_tau)] over tau in the sorted exercise times t and expiration.
+		// Exercise levels use american::step and all others the cheaper european::step.
+		template<class Phi, class X = double>
+		inline X value(X f, X s, Phi phi, std::span<const X> t, std::span<X> v)
+		{
+			ensure(std::is_sorted(t.begin(), t.end()));
+
+			size_t n = fill(f, s, v);
+			// Apply phi to F
+			std::transform(v.begin(), v.end(), v.begin(), phi);
+			// Expected value
+			size_t i = t.size(); // t[i - 1] is the next exercise time going backward
+			while (v.size() > 1) {
+				size_t k = v.size() - 2; // level after the step
+				while (i > 0 and level(t[i - 1], n) > k) {
+					--i;
+				}
+				if (i > 0 and level(t[i - 1], n) == k) {
+					v = american::step(f, s, n, phi, v);
+				}
+				else {
+					v = european::step(v);
+				}
+			}
+
+			return v[0];
+		}
+
+#ifdef _DEBUG
+		inline int test()
+		{
+			double f = 100, s = 0.1, k = 100;
+			constexpr size_t n = 100;
+			double v[n + 1];
+			// digital put, early exercise pays once in the money
+			auto p = [=](double x) { return x < k ? 1. : 0.; };
+			double va = american::value(f, s, p, std::span(v, n + 1));
+			double ve = european::value(f, s, p, std::span(v, n + 1));
+			{
+				double vb = value(f, s, p, std::span<const double>{}, std::span(v, n + 1));
+				ensure(vb == ve);
+			}
+			{
+				double t[n];
+				for (size_t i = 0; i < n; ++i) {
+					t[i] = double(i) / n;
+				}
+				double vb = value(f, s, p, std::span<const double>(t, n), std::span(v, n + 1));
+				ensure(vb == va);
+			}
+			{
+				double t[] = { 0.25, 0.5, 0.75 };
+				double vb = value(f, s, p, std::span<const double>(t, 3), std::span(v, n + 1));
+				ensure(ve < vb and vb < va);
+
+				double t2[] = { 0.125, 0.25, 0.375, 0.5, 0.625, 0.75, 0.875 };
+				double vb2 = value(f, s, p, std::span<const double>(t2, 7), std::span(v, n + 1));
+				ensure(vb < vb2 and vb2 < va);
+			}
+			{
+				// no carry so a vanilla put is never exercised early
+				auto q = [=](double x) { return std::max(k - x, 0.); };
+				double t[] = { 0.25, 0.5, 0.75 };
+				double vb = value(f, s, q, std::span<const double>(t, 3), std::span(v, n + 1));
+				ensure(fabs(vb - european::value(f, s, q, std::span(v, n + 1))) < 1e-12);
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+
+	} // namespace bermudan
 } // namespace fms::binomial
@@ -121,7 +121,7 @@ namespace fms::black::normal {
 		// c = call::value(f, s, k)
 		inline double implied(double f, double c, double k, double s = 0.1, double eps = sqrt(std::numeric_limits<double>::epsilon()))
 		{
-			return put::implied(f, c + f - k, k, s, eps);
+			return put::implied(f, c - f + k, k, s, eps);
 		}
 
 #ifdef _DEBUG
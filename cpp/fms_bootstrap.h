@@ -3,28 +3,72 @@
 #include "ensure.h"
 #include "fms_fixed_income.h"
 #include "fms_pwflat.h"
-#include "fms_secant.h"
+#include <cmath>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <initializer_list>
+#include <vector>
 
 namespace fms::bootstrap {
 
 	template<class U = double, class C = double, class T = double, class F = double>
 	inline double present_value(size_t m, const U* u, const C* c, // instrument
 		size_t n, const T* t, const F* f, // piecewise flat curve
-		F _f = std::numeric_limits<F>::quiet_NaN()) // extrapolate
+		F _f = std::numeric_limits<F>::quiet_NaN(), // extrapolate
+		const F* I = nullptr) // optional pwflat::prefix integrals
 	{
 		double pv = 0;
 
-		for (size_t i = 0; i < m; ++i) {
-			pv += c[i] * pwflat::discount(u[i], n, t, f, _f);
+		if (std::is_sorted(u, u + m)) {
+			// walk the knots once
+			pwflat::walk<T, F> w(n, t, f, _f, I);
+			for (size_t i = 0; i < m; ++i) {
+				pv += c[i] * exp(-w(u[i]));
+			}
+		}
+		else {
+			for (size_t i = 0; i < m; ++i) {
+				pv += c[i] * pwflat::discount(u[i], n, t, f, _f, I);
+			}
 		}
 
 		return pv;
 	}
 
+	// dv[k] = d present_value/d f[k], 0 <= k < n, for increasing cash flow times.
+	// If t[k-1] < u <= t[k] then dD(u)/df[j] = -D(u)(t[j] - t[j-1]) for j < k and -D(u)(u - t[k-1]) for j = k.
+	template<class U = double, class C = double, class T = double, class F = double>
+	inline void delta(size_t m, const U* u, const C* c,
+		size_t n, const T* t, const F* f, F* dv,
+		F _f = std::numeric_limits<F>::quiet_NaN(), const F* I = nullptr)
+	{
+		auto D = [=](U u_) { return pwflat::discount(u_, n, t, f, _f, I); };
+
+		// sum of c D over cash flows past t[k]
+		F R = 0;
+		size_t l = m;
+		while (l > 0 and n > 0 and u[l - 1] > t[n - 1]) {
+			--l;
+			R += c[l] * D(u[l]);
+		}
+		for (size_t k = n; k-- > 0; ) {
+			T t0 = k ? t[k - 1] : 0;
+			dv[k] = -R * (t[k] - t0);
+			while (l > 0 and u[l - 1] > t0) {
+				--l;
+				F cD = c[l] * D(u[l]);
+				dv[k] -= cD * (u[l] - t0);
+				R += cD;
+			}
+		}
+	}
+
 	// contant forward extrapolation repricing instrument
 	template<class U = double, class C = double, class T = double, class F = double>
 	inline std::pair<T, F> extend(size_t m, const U* u, const C* c,
-		size_t n, const T* t, const F* f, F p = 0, F _f = 0)
+		size_t n, const T* t, const F* f, F p = 0, F _f = 0, const F* I = nullptr)
 	{
 		ensure(m > 0);
 
@@ -37,15 +81,17 @@ namespace fms::bootstrap {
 		// last cash flow
 		auto c_ = c[m - 1];
 		// discount to end of current curve
-		auto D_ = pwflat::discount(t_, n, t, f);
+		auto D_ = pwflat::discount(t_, n, t, f, pwflat::NaN<F>, I);
 
 		// If only one cash flow occurs past the end of the curve there is a closed form solution:
 		// We have p = pv + c D e^{-f(u - t)}, where pv is the present value of all but the last
 		// cash flow, u is the last cash flow time, and c is the last cash flow.
 		if (m == 1 || m == 2 && u[0] <= t_) { // ??? m > 2 ???
-			auto pv = present_value(m - 1, u, c, n, t, f);
+			auto pv = present_value(m - 1, u, c, n, t, f, pwflat::NaN<F>, I);
+			F x = log((p - pv) / (c_ * D_)) / (t_ - u_);
+			ensure(std::isfinite(x) || !"bootstrap::extend: price cannot be reached");
 
-			return { u_, log((p - pv) / (c_ * D_)) / (t_ - u_) };
+			return { u_, x };
 		}
 
 		// If exactly two cash flows and price is 0, then we know u[0] > t_ or else
@@ -53,26 +99,52 @@ namespace fms::bootstrap {
 		// 0 = c0 D exp(-f(u0 - t)) + c1 D exp(-f(u1 - t)) so
 		// f = - log(-c0/c1)/(u1 - u0).
 		if (p == 0 && m == 2) {
-			return { u_, log(-c[0] / c[1]) / (u[0] - u[1]) };
+			F x = log(-c[0] / c[1]) / (u[0] - u[1]);
+			ensure(std::isfinite(x) || !"bootstrap::extend: price cannot be reached");
+
+			return { u_, x };
 		}
 
-		auto pv = [m, u, c, n, t, f, p](double _f) {
-			return -p + present_value(m, u, c, n, t, f, _f);
-		};
+		// Only cash flows past the end of the curve depend on the new forward x.
+		// Solve g(x) = -p + pv + D sum_{u[i] > t} c[i] exp(-x (u[i] - t)) = 0 using Newton
+		// with g'(x) = D sum_{u[i] > t} c[i] (t - u[i]) exp(-x (u[i] - t)).
+		size_t j = std::upper_bound(u, u + m, t_) - u;
+		auto pv = present_value(j, u, c, n, t, f, pwflat::NaN<F>, I);
 
 		// use last forward as initial guess
 		if (_f == 0) {
 			_f = (n == 0) ? 0.01 : f[n - 1];
 		}
 
-		return { u_, secant::solve(pv, _f, _f + 0.001) };
+		F x = _f, x_ = pwflat::NaN<F>;
+		for (int iter = 0; iter < 100; ++iter) {
+			F g = pv - p, dg = 0;
+			for (size_t i = j; i < m; ++i) {
+				auto D = D_ * exp(-x * (u[i] - t_));
+				g += c[i] * D;
+				dg += c[i] * (t_ - u[i]) * D;
+			}
+			auto dx = g / dg;
+			// dg == 0 or diverging
+			if (!std::isfinite(dx) || !std::isfinite(x - dx)) {
+				break;
+			}
+			x -= dx;
+			if (fabs(dx) <= 1e-12) {
+				x_ = x;
+				break;
+			}
+		}
+		ensure(x_ == x_ || !"bootstrap::extend: failed to converge");
+
+		return { u_, x_ };
 	}
 
-	template<class U = double, class C = double, class T = double, class F = double>
-	inline pwflat::curve<T, F>& extend(const fixed_income::instrument<U, C>& i, pwflat::curve<T, F>& f,
+	template<class U = double, class C = double, class T = double, class F = double, size_t N = 0>
+	inline pwflat::curve<T, F, N>& extend(const fixed_income::instrument<U, C>& i, pwflat::curve<T, F, N>& f,
 		F p = 0, F _f = 0)
 	{
-		auto [u_, f_] = extend(i.size(), i.time(), i.cash(), f.size(), f.time(), f.forward(), p, _f);
+		auto [u_, f_] = extend(i.size(), i.time(), i.cash(), f.size(), f.time(), f.forward(), p, _f, f.prefix());
 
 		return f.extend(u_, f_);
 	}
@@ -84,6 +156,22 @@ namespace fms::bootstrap {
 		constexpr double eps = std::numeric_limits<double>::epsilon();
 		double c = log(2.);
 
+		{
+			// prices that no forward reaches: closed form, two cash flows, and Newton
+			inst i[] = { inst({ 0, 1 }, { 1, 1 }), inst({ 1, 2 }, { 1, 1 }), inst({ 0, 1, 2, 3 }, { 1, 1, 1, 1 }) };
+			for (const auto& i_ : i) {
+				bool thrown = false;
+				try {
+					pwflat::curve<> f;
+					extend(i_, f);
+				}
+				catch (const std::runtime_error&) {
+					thrown = true;
+				}
+				ensure(thrown);
+			}
+		}
+
 		{
 			pwflat::curve<> f;
 			inst i0({ 0, 1 }, { -1, 2 });
@@ -163,18 +251,447 @@ namespace fms::bootstrap {
 	}
 #endif // _DEBUG
 
+	// Index of (i, j), j <= i, in packed lower triangular storage.
+	inline constexpr size_t packed(size_t i, size_t j)
+	{
+		return i * (i + 1) / 2 + j;
+	}
+
+	// If J is not null it is set to the packed lower triangular Jacobian df[i]/dp[j] of
+	// forwards with respect to instrument prices. Forward i only depends on prices j <= i.
+	// Differentiating pv_i(f[0], ..., f[i]) = p[i] gives sum_{k <= i} dpv_i/df[k] J[k,j] = delta_ij.
 	template<class I, class T = double, class F = double>
-	inline pwflat::curve<T, F> build(const I& is)
+	inline pwflat::curve<T, F> build(const I& is, std::vector<F>* J = nullptr)
 	{
 		pwflat::curve<T, F> f;
+		std::vector<F> A; // dpv_i/df[k]
 
+		if (J) {
+			J->clear();
+		}
 		for (const auto& i : is) {
-			f = extend(*i, f);
+			extend(*i, f);
+			if (J) {
+				size_t n = f.size();
+				A.resize(n);
+				delta(i->size(), i->time(), i->cash(), n, f.time(), f.forward(), A.data(), f.extrapolate(), f.prefix());
+				size_t r = n - 1;
+				J->resize(packed(n, 0));
+				F* Jr = J->data() + packed(r, 0);
+				for (size_t j = 0; j <= r; ++j) {
+					F s = j == r ? 1 : 0;
+					for (size_t k = j; k < r; ++k) {
+						s -= A[k] * (*J)[packed(k, j)];
+					}
+					Jr[j] = s / A[r];
+				}
+			}
 		}
 
 		return f;
 	}
 
+	// Price level risk dv/dp[j] = sum_{i >= j} dv/df[i] J[i,j] from forward sensitivities dv/df.
+	template<class F>
+	inline void risk(size_t n, const F* J, const F* dvdf, F* dvdp)
+	{
+		for (size_t j = 0; j < n; ++j) {
+			dvdp[j] = 0;
+		}
+		for (size_t i = 0; i < n; ++i) {
+			const F* Ji = J + packed(i, 0);
+			for (size_t j = 0; j <= i; ++j) {
+				dvdp[j] += dvdf[i] * Ji[j];
+			}
+		}
+	}
+
+	// Convert the price Jacobian J from build to the quote Jacobian df[i]/dq[j] in place.
+	// Bumping quote q[j] with the curve fixed changes pv_j by a[j] = dpv_j/dq[j], the present value
+	// of the derivative of the cash flows of instrument j with respect to its quote, e.g. the fixed leg
+	// annuity of a par swap or u D(u) for a deposit with rate r and cash flow 1 + r u at u.
+	// Repricing to p[j] needs the same curve change as the price moving by -a[j], so df[i]/dq[j] = -J[i,j] a[j].
+	// risk with the quote Jacobian gives dv/dq per unit of rate, multiply by 0.0001 for risk per basis point.
+	template<class F>
+	inline void quote(size_t n, F* J, const F* a)
+	{
+		for (size_t i = 0; i < n; ++i) {
+			F* Ji = J + packed(i, 0);
+			for (size_t j = 0; j <= i; ++j) {
+				Ji[j] *= -a[j];
+			}
+		}
+	}
+
+#ifdef _DEBUG
+	// Test fixtures shared with fms.t.cpp.
+	// Annual par swap receiving c at 1, ..., T - 1 and 1 + c at T for 1 at time 0.
+	inline fixed_income::instrument_value<> par_swap(int T, double c)
+	{
+		fixed_income::instrument_value<> i({ 0 }, { -1 });
+		for (int k = 1; k <= T; ++k) {
+			i.extend(k, k < T ? c : 1 + c);
+		}
+
+		return i;
+	}
+	// Cash deposits at rate r for each maturity in u, then par swaps to 1, ..., T years with coupon c + dc T.
+	inline std::vector<fixed_income::instrument_value<>> deposits_swaps(std::initializer_list<double> u, double r, int T, double c, double dc = 0)
+	{
+		std::vector<fixed_income::instrument_value<>> is;
+		for (double u_ : u) {
+			is.push_back(fixed_income::cash_deposit<>(u_, r));
+		}
+		for (int T_ = 1; T_ <= T; ++T_) {
+			is.push_back(par_swap(T_, c + dc * T_));
+		}
+
+		return is;
+	}
+	// Instrument pointers for build, fit, and scenarios. The instruments must outlive them.
+	template<class I>
+	inline std::vector<const fixed_income::instrument<>*> pointers(const std::vector<I>& is)
+	{
+		std::vector<const fixed_income::instrument<>*> ps;
+		ps.reserve(is.size());
+		for (const auto& i : is) {
+			ps.push_back(&i);
+		}
+
+		return ps;
+	}
+
+	inline int jacobian_test()
+	{
+		using inst = fixed_income::instrument_value<>;
+		auto is = deposits_swaps({ 0.5 }, 0.03, 10, 0.03, 0.001);
+		auto ps = pointers(is);
+		size_t n = is.size();
+
+		std::vector<double> J;
+		auto f = build(ps, &J);
+		ensure(J.size() == packed(n, 0));
+
+		// bump price j and rebuild
+		double h = 1e-6;
+		auto bumped = [&](size_t j, double p) {
+			pwflat::curve<> g;
+			for (size_t i = 0; i < n; ++i) {
+				extend(is[i], g, i == j ? p : 0.);
+			}
+			return g;
+		};
+		for (size_t j = 0; j < n; ++j) {
+			auto up = bumped(j, h), dn = bumped(j, -h);
+			for (size_t i = 0; i < n; ++i) {
+				double dfdp = (up.forward()[i] - dn.forward()[i]) / (2 * h);
+				ensure(fabs(dfdp - (i >= j ? J[packed(i, j)] : 0)) < 1e-6);
+			}
+		}
+
+		// risk of an off market swap to instrument prices
+		inst v = par_swap(7, 0.05);
+		std::vector<double> dvdf(n), dvdp(n);
+		delta(v.size(), v.time(), v.cash(), n, f.time(), f.forward(), dvdf.data());
+		risk(n, J.data(), dvdf.data(), dvdp.data());
+		for (size_t j = 0; j < n; ++j) {
+			auto up = bumped(j, h), dn = bumped(j, -h);
+			double pu = present_value(v.size(), v.time(), v.cash(), n, up.time(), up.forward());
+			double pd = present_value(v.size(), v.time(), v.cash(), n, dn.time(), dn.forward());
+			ensure(fabs(dvdp[j] - (pu - pd) / (2 * h)) < 1e-6);
+		}
+
+		// risk to the deposit rate and swap par rates
+		std::vector<double> a(n), dvdq(n);
+		a[0] = 0.5 * f.discount(0.5);
+		for (size_t j = 1; j < n; ++j) {
+			a[j] = 0;
+			for (size_t k = 1; k <= j; ++k) {
+				a[j] += f.discount(double(k));
+			}
+		}
+		quote(n, J.data(), a.data());
+		risk(n, J.data(), dvdf.data(), dvdq.data());
+		auto requoted = [&](size_t j, double dq) {
+			std::vector<inst> js;
+			js.push_back(fixed_income::cash_deposit<>(0.5, 0.03 + (j == 0 ? dq : 0)));
+			for (size_t T = 1; T < n; ++T) {
+				js.push_back(par_swap(int(T), 0.03 + 0.001 * T + (j == T ? dq : 0)));
+			}
+			return build(pointers(js));
+		};
+		for (size_t j = 0; j < n; ++j) {
+			auto up = requoted(j, h), dn = requoted(j, -h);
+			double pu = present_value(v.size(), v.time(), v.cash(), n, up.time(), up.forward());
+			double pd = present_value(v.size(), v.time(), v.cash(), n, dn.time(), dn.forward());
+			ensure(fabs(dvdq[j] - (pu - pd) / (2 * h)) < 1e-6);
+		}
+		ensure(dvdq[7] < -1); // raising the 7 year par rate lowers a 7 year receiver
+
+		return 0;
+	}
+#endif // _DEBUG
+
+#ifdef _DEBUG
+	inline int build_test()
+	{
+		// deposits and annual par swaps at 3%
+		auto is = deposits_swaps({ 0.25, 0.5 }, 0.03, 30, 0.03);
+		auto ps = pointers(is);
+
+		auto f = build(ps);
+		ensure(f.size() == is.size());
+		for (const auto& i : is) {
+			double pv = present_value(i.size(), i.time(), i.cash(), f.size(), f.time(), f.forward());
+			ensure(fabs(pv) < 1e-12);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+	// Curve bootstrapped from instruments and prices that can change one at a time.
+	// Instrument j determines forward j so a change to j only re-solves forwards j, j + 1, ...
+	// using the previous forwards as initial guesses.
+	template<class T = double, class F = double, class U = double, class C = double>
+	class live {
+		std::vector<fixed_income::instrument_value<U, C>> is;
+		std::vector<F> p;  // prices
+		std::vector<F> f_; // previous solution
+		pwflat::curve<T, F> f;
+		size_t version_;
+
+		// re-solve from instrument j
+		void solve(size_t j)
+		{
+			f.truncate(j);
+			for (size_t i = j; i < is.size(); ++i) {
+				extend(is[i], f, p[i], f_[i]);
+				f_[i] = f.back().second;
+			}
+			++version_;
+		}
+	public:
+		live()
+			: version_(0)
+		{ }
+		live(const live&) = default;
+		live& operator=(const live&) = default;
+		~live()
+		{ }
+
+		size_t size() const
+		{
+			return is.size();
+		}
+		// incremented on every change to the curve
+		size_t version() const
+		{
+			return version_;
+		}
+		const pwflat::curve<T, F>& curve() const
+		{
+			return f;
+		}
+		F price(size_t j) const
+		{
+			return p[j];
+		}
+
+		// Append instrument maturing after the end of the curve.
+		live& add(const fixed_income::instrument<U, C>& i, F p_ = 0)
+		{
+			is.emplace_back(i.size(), i.time(), i.cash());
+			p.push_back(p_);
+			f_.push_back(0);
+			solve(is.size() - 1);
+
+			return *this;
+		}
+		// Change the price of instrument j.
+		live& price(size_t j, F p_)
+		{
+			ensure(j < size());
+
+			if (p[j] != p_) {
+				p[j] = p_;
+				solve(j);
+			}
+
+			return *this;
+		}
+		// Replace instrument j, e.g. for a new rate, with the same termination.
+		live& instrument(size_t j, const fixed_income::instrument<U, C>& i)
+		{
+			ensure(j < size());
+			ensure(i.termination() == is[j].termination());
+
+			is[j] = fixed_income::instrument_value<U, C>(i.size(), i.time(), i.cash());
+			solve(j);
+
+			return *this;
+		}
+	};
+
+#ifdef _DEBUG
+	inline int live_test()
+	{
+		live<> L;
+		L.add(fixed_income::cash_deposit<>(0.5, 0.03));
+		for (int T = 1; T <= 30; ++T) {
+			L.add(par_swap(T, 0.03 + 0.0001 * T));
+		}
+		ensure(L.size() == 31);
+		size_t v = L.version();
+
+		auto f0 = L.curve();
+		L.price(10, 0.001);
+		ensure(L.version() > v);
+		{
+			// same as building from scratch
+			pwflat::curve<> f;
+			extend(fixed_income::cash_deposit<>(0.5, 0.03), f);
+			for (int T = 1; T <= 30; ++T) {
+				extend(par_swap(T, 0.03 + 0.0001 * T), f, T == 10 ? 0.001 : 0.);
+			}
+			for (size_t i = 0; i < f.size(); ++i) {
+				if (i < 10) {
+					ensure(L.curve().forward()[i] == f0.forward()[i]);
+				}
+				ensure(fabs(L.curve().forward()[i] - f.forward()[i]) < 1e-14);
+			}
+		}
+		{
+			// new rate on instrument 20
+			v = L.version();
+			L.instrument(20, par_swap(20, 0.035));
+			ensure(L.version() > v);
+			const auto& c = L.curve();
+			auto i = par_swap(20, 0.035);
+			double pv = present_value(i.size(), i.time(), i.cash(), c.size(), c.time(), c.forward());
+			ensure(fabs(pv) < 1e-12);
+		}
+		{
+			// no change
+			v = L.version();
+			L.price(5, L.price(5));
+			ensure(L.version() == v);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+	// Bootstrap the same n instruments under S scenarios of prices p[s*n + i] on a pool of threads.
+	// Knots t[i] are the instrument terminations and forwards are written to f[s*n + i].
+	// Each thread owns its prefix integral scratch so there is no allocation per scenario.
+	template<class U = double, class C = double, class T = double, class F = double>
+	inline void scenarios(size_t n, const fixed_income::instrument<U, C>* const* is,
+		size_t S, const F* p, T* t, F* f, size_t threads = 0)
+	{
+		for (size_t i = 0; i < n; ++i) {
+			t[i] = is[i]->termination();
+			ensure(i == 0 or t[i] > t[i - 1]);
+		}
+		if (threads == 0) {
+			threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+		}
+		threads = std::min(threads, std::max<size_t>(S, 1));
+
+		std::atomic<size_t> next = 0;
+		constexpr size_t chunk = 16; // scenarios per grab
+		// an exception escaping a thread calls terminate so each thread keeps its own
+		std::vector<std::exception_ptr> e(threads);
+		auto work = [&, n, S](size_t k) {
+			try {
+				std::vector<F> I(n);
+				for (size_t s0 = next.fetch_add(chunk); s0 < S; s0 = next.fetch_add(chunk)) {
+					for (size_t s = s0; s < std::min(S, s0 + chunk); ++s) {
+						const F* ps = p + s * n;
+						F* fs = f + s * n;
+						for (size_t i = 0; i < n; ++i) {
+							const auto& ii = *is[i];
+							// previous scenario forward as initial guess
+							F guess = s > s0 ? f[(s - 1) * n + i] : 0;
+							auto [u_, f_] = extend(ii.size(), ii.time(), ii.cash(), i, t, fs, ps[i], guess, I.data());
+							fs[i] = f_;
+							I[i] = (i ? I[i - 1] : 0) + f_ * (t[i] - (i ? t[i - 1] : 0));
+						}
+					}
+				}
+			}
+			catch (...) {
+				e[k] = std::current_exception();
+				next = S; // stop the other threads
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (size_t k = 1; k < threads; ++k) {
+			pool.emplace_back(work, k);
+		}
+		work(0);
+		for (auto& th : pool) {
+			th.join();
+		}
+		for (const auto& e_ : e) {
+			if (e_) {
+				std::rethrow_exception(e_);
+			}
+		}
+	}
+
+#ifdef _DEBUG
+	inline int scenarios_test()
+	{
+		auto is = deposits_swaps({ 0.5 }, 0.03, 10, 0.03);
+		auto ps = pointers(is);
+		size_t n = is.size(), S = 50;
+		std::vector<double> p(S * n), t(n), f(S * n);
+		for (size_t s = 0; s < S; ++s) {
+			for (size_t i = 0; i < n; ++i) {
+				p[s * n + i] = 0.001 * sin(double(s * n + i));
+			}
+		}
+
+		for (size_t threads : {1, 3}) {
+			scenarios(n, ps.data(), S, p.data(), t.data(), f.data(), threads);
+			for (size_t s = 0; s < S; ++s) {
+				pwflat::curve<> g;
+				for (size_t i = 0; i < n; ++i) {
+					extend(is[i], g, p[s * n + i]);
+				}
+				for (size_t i = 0; i < n; ++i) {
+					ensure(t[i] == g.time()[i]);
+					ensure(fabs(f[s * n + i] - g.forward()[i]) < 1e-14);
+				}
+			}
+		}
+		{
+			// exceptions on worker threads are rethrown after join
+			struct bad : fixed_income::instrument_ptr<> {
+				using instrument_ptr::instrument_ptr;
+				const double* _cash() const override
+				{
+					throw std::runtime_error("bad cash flows");
+				}
+			};
+			bad b(is[n - 1].size(), is[n - 1].time(), is[n - 1].cash());
+			ps[n - 1] = &b;
+			bool thrown = false;
+			try {
+				scenarios(n, ps.data(), S, p.data(), t.data(), f.data(), 3);
+			}
+			catch (const std::runtime_error&) {
+				thrown = true;
+			}
+			ensure(thrown);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
 	// Build from two lists of instruments.
 	// Take from first while termination less than initial second effective.
 	template<class I, class J, class T = double, class F = double>
@@ -189,17 +706,273 @@ namespace fms::bootstrap {
 
 		for (const auto& i : is) {
 			if (i->termination() < eff) {
-				f = extend(*i, f);
+				extend(*i, f);
 			}
 			else {
 				break;
 			}
 		}
 		for (const auto& j : js) {
-			f = extend(*j, f);
+			extend(*j, f);
 		}
 
 		return f;
 	}
 
+	// Fit forwards at the distinct instrument terminations to all instruments at once by
+	// Levenberg-Marquardt. Instruments must be sorted by termination and may share terminations
+	// or have cash flows straddling knots. The residual of instrument i with effective e and price p is
+	// r_i = sum_j c_j D(u_j)/D(e) - p/D(e) which only depends on forwards over (e, u] when p = 0,
+	// so the normal equations are banded for forward starting instruments.
+	// Stop when the rms residual is at most tol or the step is negligible, e.g. for inconsistent quotes.
+	// Warm start from the sequential bootstrap. Return an empty curve if not converged.
+	template<class I, class T = double, class F = double>
+	inline pwflat::curve<T, F> fit(const I& is, const F* p = nullptr, F tol = 1e-12, size_t iter = 50)
+	{
+		std::vector<const fixed_income::instrument<T, F>*> ii;
+		for (const auto& i : is) {
+			ii.push_back(&*i);
+		}
+		size_t n = ii.size();
+		if (n == 0) {
+			return pwflat::curve<T, F>{};
+		}
+
+		// knots
+		std::vector<T> t;
+		for (const auto i : ii) {
+			ensure(i->size() > 0);
+			ensure(t.empty() or i->termination() >= t.back());
+			if (t.empty() or i->termination() > t.back()) {
+				t.push_back(i->termination());
+			}
+		}
+		size_t K = t.size();
+		auto seg = [&t](T x) { return size_t(std::lower_bound(t.begin(), t.end(), x) - t.begin()); };
+		auto price = [p](size_t i) { return p ? p[i] : F(0); };
+
+		// nonzero columns [lo[i], hi[i]] of row i stored at A[off[i]]
+		std::vector<size_t> lo(n), hi(n), off(n + 1);
+		size_t w = 0; // half bandwidth of A^T A
+		for (size_t i = 0; i < n; ++i) {
+			lo[i] = price(i) == 0 ? seg(ii[i]->effective()) : 0;
+			hi[i] = seg(ii[i]->termination());
+			off[i + 1] = off[i] + hi[i] - lo[i] + 1;
+			w = std::max(w, hi[i] - lo[i]);
+		}
+		std::vector<F> A(off[n]), r(n), Ip(K), cE;
+
+		// residuals and optionally the Jacobian, return sum of squares
+		auto eval = [&](const std::vector<F>& f, bool jac) {
+			pwflat::prefix(K, t.data(), f.data(), Ip.data());
+			auto integral = [&](T x) { return pwflat::integral(x, K, t.data(), f.data(), pwflat::NaN<F>, Ip.data()); };
+			// length of (a, b] in segment k
+			auto overlap = [&t](size_t k, T a, T b) {
+				T t0 = k ? t[k - 1] : 0;
+				return std::max(T(0), std::min(b, t[k]) - std::max(a, t0));
+			};
+			F ss = 0;
+			for (size_t i = 0; i < n; ++i) {
+				const T* u = ii[i]->time();
+				const F* c = ii[i]->cash();
+				T e = ii[i]->effective();
+				F Ie = integral(e);
+				F* Ai = A.data() + off[i];
+				if (jac) {
+					std::fill(Ai, Ai + hi[i] - lo[i] + 1, F(0));
+				}
+				F ri = 0;
+				if (price(i) != 0) {
+					F pe = price(i) * exp(Ie);
+					ri -= pe;
+					if (jac) {
+						for (size_t k = lo[i]; k <= hi[i]; ++k) {
+							Ai[k - lo[i]] -= pe * overlap(k, 0, e);
+						}
+					}
+				}
+				// cash flows discounted to e, walking the knots once
+				size_t m = ii[i]->size();
+				cE.resize(std::max(cE.size(), m));
+				pwflat::walk<T, F> wk(K, t.data(), f.data(), pwflat::NaN<F>, Ip.data());
+				for (size_t j = 0; j < m; ++j) {
+					cE[j] = c[j] * exp(Ie - wk(u[j]));
+					ri += cE[j];
+				}
+				if (jac) {
+					// segment k over (a, t[k]], a = max(e, t[k - 1]), gets -cE (min(u, t[k]) - a) from u > a
+					F R = 0; // sum of cE with u > t[k]
+					size_t l = m;
+					for (size_t k = hi[i] + 1; k-- > seg(e); ) {
+						T a = std::max(e, k ? t[k - 1] : T(0));
+						F& Aik = Ai[k - lo[i]];
+						Aik -= R * std::max(T(0), t[k] - a);
+						while (l > 0 and u[l - 1] > a) {
+							--l;
+							Aik -= cE[l] * (u[l] - a);
+							R += cE[l];
+						}
+					}
+				}
+				r[i] = ri;
+				ss += ri * ri;
+			}
+
+			return ss;
+		};
+
+		// warm start from the sequential bootstrap
+		std::vector<F> f(K, F(0.01));
+		{
+			std::vector<F> I_(K);
+			size_t k = 0;
+			for (size_t i = 0; i < n and k < K; ++i) {
+				if (ii[i]->termination() != t[k]) {
+					continue;
+				}
+				auto [u_, f_] = extend(ii[i]->size(), ii[i]->time(), ii[i]->cash(), k, t.data(), f.data(), price(i), F(0), I_.data());
+				f[k] = f_ == f_ ? f_ : (k ? f[k - 1] : F(0.01));
+				I_[k] = (k ? I_[k - 1] : 0) + f[k] * (t[k] - (k ? t[k - 1] : 0));
+				++k;
+			}
+		}
+
+		// banded N = A^T A, N(a, b) at B[a*(w + 1) + a - b] for a - w <= b <= a
+		std::vector<F> N(K * (w + 1)), L(K * (w + 1)), g(K), dx(K), f_(K);
+		auto at = [w](std::vector<F>& B, size_t a, size_t b) -> F& { return B[a * (w + 1) + a - b]; };
+
+		F ss = eval(f, true);
+		F lambda = F(1e-3);
+		bool done = false;
+		for (size_t it = 0; it < iter and !done; ++it) {
+			if (std::sqrt(ss / n) <= tol) {
+				done = true;
+				break;
+			}
+			std::fill(N.begin(), N.end(), F(0));
+			std::fill(g.begin(), g.end(), F(0));
+			for (size_t i = 0; i < n; ++i) {
+				const F* Ai = A.data() + off[i];
+				for (size_t a = lo[i]; a <= hi[i]; ++a) {
+					g[a] += Ai[a - lo[i]] * r[i];
+					for (size_t b = lo[i]; b <= a; ++b) {
+						at(N, a, b) += Ai[a - lo[i]] * Ai[b - lo[i]];
+					}
+				}
+			}
+
+			bool accepted = false;
+			while (!accepted and lambda < F(1e12)) {
+				// banded Cholesky of N + lambda diag(N)
+				for (size_t j = 0; j < K; ++j) {
+					size_t j0 = j > w ? j - w : 0;
+					F d = at(N, j, j) * (1 + lambda);
+					for (size_t k = j0; k < j; ++k) {
+						d -= at(L, j, k) * at(L, j, k);
+					}
+					ensure(d > 0);
+					at(L, j, j) = std::sqrt(d);
+					for (size_t i = j + 1; i < std::min(K, j + w + 1); ++i) {
+						size_t i0 = i > w ? i - w : 0;
+						F s_ = at(N, i, j);
+						for (size_t k = std::max(i0, j0); k < j; ++k) {
+							s_ -= at(L, i, k) * at(L, j, k);
+						}
+						at(L, i, j) = s_ / at(L, j, j);
+					}
+				}
+				// L L^T dx = -g
+				for (size_t i = 0; i < K; ++i) {
+					F s_ = -g[i];
+					for (size_t k = i > w ? i - w : 0; k < i; ++k) {
+						s_ -= at(L, i, k) * dx[k];
+					}
+					dx[i] = s_ / at(L, i, i);
+				}
+				for (size_t i = K; i-- > 0; ) {
+					F s_ = dx[i];
+					for (size_t k = i + 1; k < std::min(K, i + w + 1); ++k) {
+						s_ -= at(L, k, i) * dx[k];
+					}
+					dx[i] = s_ / at(L, i, i);
+				}
+
+				for (size_t k = 0; k < K; ++k) {
+					f_[k] = f[k] + dx[k];
+				}
+				F dmax = 0;
+				for (size_t k = 0; k < K; ++k) {
+					dmax = std::max(dmax, fabs(dx[k]));
+				}
+				if (dmax <= 1e-14) {
+					done = true;
+					break;
+				}
+				F ss_ = eval(f_, false);
+				if (ss_ < ss) {
+					std::swap(f, f_);
+					ss = eval(f, true);
+					lambda /= 3;
+					accepted = true;
+				}
+				else {
+					lambda *= 4;
+				}
+			}
+			if (!accepted) {
+				break;
+			}
+		}
+		done = done or std::sqrt(ss / n) <= tol;
+
+		return done ? pwflat::curve<T, F>(t, f) : pwflat::curve<T, F>{};
+	}
+
+#ifdef _DEBUG
+	inline int fit_test()
+	{
+		using inst = fixed_income::instrument_value<>;
+		{
+			// same as sequential bootstrap when exactly determined
+			auto is = deposits_swaps({ 0.5 }, 0.03, 20, 0.03, 0.0005);
+			auto ps = pointers(is);
+			auto f = build(ps);
+			auto g = fit(ps);
+			ensure(g.size() == f.size());
+			for (size_t k = 0; k < f.size(); ++k) {
+				ensure(fabs(g.forward()[k] - f.forward()[k]) < 1e-10);
+			}
+		}
+		{
+			// overlapping deposits, FRAs, and swaps
+			std::vector<inst> is;
+			is.push_back(fixed_income::cash_deposit<>(0.25, 0.03));
+			is.push_back(fixed_income::forward_rate_agreement<>(0.25, 0.75, 0.031));
+			is.push_back(fixed_income::forward_rate_agreement<>(0.5, 1.0, 0.032));
+			is.push_back(fixed_income::forward_rate_agreement<>(0.75, 1.25, 0.033));
+			is.push_back(par_swap(2, 0.034));
+			is.push_back(par_swap(3, 0.035));
+			auto ps = pointers(is);
+			auto g = fit(ps);
+			ensure(g.size() == is.size());
+			for (const auto& i : is) {
+				double pv = present_value(i.size(), i.time(), i.cash(), g.size(), g.time(), g.forward());
+				ensure(fabs(pv) < 1e-10);
+			}
+		}
+		{
+			// inconsistent quotes with the same termination are fit in the least squares sense
+			std::vector<inst> is;
+			is.push_back(fixed_income::cash_deposit<>(1., 0.03));
+			is.push_back(fixed_income::cash_deposit<>(1., 0.032));
+			std::vector<const inst*> ps = { &is[0], &is[1] };
+			auto g = fit(ps);
+			ensure(g.size() == 1);
+			ensure(fabs(g.forward()[0] - 0.031) < 1e-4);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
 } // namespace fms::bootstrap
\ No newline at end of file
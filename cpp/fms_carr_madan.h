@@ -9,18 +9,64 @@
 // f_(x) = f(a) + f'(a)(x - a) + sum_{k[i] <= a} (k[i] - x)^+ mm[i] + sum_{k[i] > a} (x - k[i])^+ mm[i]
 #pragma once
 #include "ensure.h"
+#include <algorithm>
 #include <span>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace fms::carr_madan {
 
 	template<class X>
 	constexpr X NaN = std::numeric_limits<X>::quiet_NaN();
 
+	// Branchless lower bound: the loop trip count only depends on xs.size().
+	template<class X>
+	inline constexpr size_t lower_bound(const X& x, std::span<const X> xs)
+	{
+		size_t len = xs.size();
+		if (len == 0) {
+			return 0;
+		}
+		const X* b = xs.data();
+		while (len > 1) {
+			size_t half = len / 2;
+			b += (b[half - 1] < x) * half;
+			len -= half;
+		}
+
+		return (b - xs.data()) + (*b < x);
+	}
+
 	// First index of xs where x > xs[i] is false so xs[i - 1] < x <= xs[i]
 	template<class X = double, size_t N>
-	inline constexpr auto index(const X& x, const std::span<X, N>& xs)
+	inline constexpr size_t index(const X& x, const std::span<X, N>& xs)
 	{
-		return std::lower_bound(xs.begin(), xs.end(), x) - xs.begin();
+		using Y = std::remove_const_t<X>;
+
+		return lower_bound<Y>(x, std::span<const Y>(xs));
+	}
+
+	// i[j] = index(x[j], xs). Merge walk in O(m + n) if x is sorted, otherwise branchless search.
+	template<class X>
+	inline void index(std::span<const X> x, std::span<const X> xs, std::span<size_t> i)
+	{
+		ensure(x.size() == i.size());
+
+		if (std::is_sorted(x.begin(), x.end())) {
+			size_t l = 0;
+			for (size_t j = 0; j < x.size(); ++j) {
+				while (l < xs.size() and xs[l] < x[j]) {
+					++l;
+				}
+				i[j] = l;
+			}
+		}
+		else {
+			for (size_t j = 0; j < x.size(); ++j) {
+				i[j] = lower_bound(x[j], xs);
+			}
+		}
 	}
 
 #ifdef _DEBUG
@@ -41,6 +87,19 @@ namespace fms::carr_madan {
 				}
 			}
 		}
+		{
+			// batch agrees with index for sorted and unsorted queries
+			double xs[] = { 1, 2, 2, 3, 5, 8 };
+			double x[] = { 0., 1., 1.5, 2., 2.5, 3., 4., 8., 9. };
+			double y[] = { 9., 2., 0., 8., 1.5, 4., 1., 3., 2.5 };
+			size_t i[9];
+			for (auto z : {std::span<const double>(x), std::span<const double>(y)}) {
+				index(z, std::span<const double>(xs), std::span(i));
+				for (size_t j = 0; j < 9; ++j) {
+					ensure(i[j] == index(z[j], std::span(xs)));
+				}
+			}
+		}
 
 		return 0;
 	}
@@ -87,6 +146,49 @@ namespace fms::carr_madan {
 		return { fx, mx };
 	}
 
+	// fx[j], mx[j] = tangent(x[j], k, f) using batch index
+	template<class X>
+	inline void tangent(std::span<const X> x, std::span<const X> k, std::span<const X> f,
+		std::span<X> fx, std::span<X> mx)
+	{
+		ensure(k.size() == f.size());
+		ensure(x.size() == fx.size() and x.size() == mx.size());
+
+		size_t n = k.size();
+		auto at = [n, &k, &f, &fx, &mx](size_t j, X xj, size_t i) {
+			if (n == 0) {
+				fx[j] = NaN<X>;
+				mx[j] = NaN<X>;
+			}
+			else if (n == 1) {
+				fx[j] = f[0];
+				mx[j] = 0;
+			}
+			else {
+				// segment (k[l], k[l + 1]] and base point k[b] as in tangent
+				size_t l = i == 0 ? 0 : i == n ? n - 2 : i - 1;
+				size_t b = (i == 0 or n == 2) ? l : l + 1;
+				mx[j] = (f[l + 1] - f[l]) / (k[l + 1] - k[l]);
+				fx[j] = f[b] + mx[j] * (xj - k[b]);
+			}
+		};
+
+		if (std::is_sorted(x.begin(), x.end())) {
+			size_t i = 0;
+			for (size_t j = 0; j < x.size(); ++j) {
+				while (i < n and k[i] < x[j]) {
+					++i;
+				}
+				at(j, x[j], i);
+			}
+		}
+		else {
+			for (size_t j = 0; j < x.size(); ++j) {
+				at(j, x[j], lower_bound(x[j], k));
+			}
+		}
+	}
+
 #ifdef _DEBUG
 	inline int test_tangent()
 	{
@@ -128,6 +230,19 @@ namespace fms::carr_madan {
 				auto [f, m] = tangent(4.1, std::span(ks), std::span(fs));
 				ensure(f == 0 and m == 0);
 			}
+			{
+				// batch agrees with tangent for sorted and unsorted queries
+				double x[] = { -1., 0., .5, 1., 1.5, 2., 2.5, 3.5, 4.1 };
+				double y[] = { 2.5, -1., 4.1, 1., .5, 3.5, 0., 2., 1.5 };
+				double fx[9], mx[9];
+				for (auto z : {std::span<const double>(x), std::span<const double>(y)}) {
+					tangent(z, std::span<const double>(ks), std::span<const double>(fs), std::span<double>(fx), std::span<double>(mx));
+					for (size_t j = 0; j < 9; ++j) {
+						auto [f, m] = tangent(z[j], std::span(ks), std::span(fs));
+						ensure(fx[j] == f and mx[j] == m);
+					}
+				}
+			}
 
 		}
 
@@ -199,6 +314,7 @@ namespace fms::carr_madan {
 #endif // _DEBUG
 	
 	// value pwlinear k, f, using forward x, puts below a, and calls above a
+	// f is not modified.
 	template<class X>
 	inline constexpr X value(const X& x, const X& a, const std::span<X>& p, const std::span<X>& c,
 		const std::span<X>& k, std::span<X> f)
@@ -211,18 +327,283 @@ namespace fms::carr_madan {
 		auto [fa, ma] = tangent(a, k, f);
 		X v = fa + ma * (x - a);
 
-		fit(k, f);
+		// jump in slope at k[i] is m[i] - m[i - 1], same operations as fit
+		auto m = [&k, &f](size_t i) { return (f[i + 1] - f[i]) / (k[i + 1] - k[i]); };
 		size_t i = 1;
 		for (; i < n - 1 and k[i] < a; ++i) {
-			v += p[i] * f[i + 1];
+			v += p[i] * (m(i) - m(i - 1));
 		}
 		for (; i < n - 1; ++i) {
-			v += c[i] * f[i + 1];
+			v += c[i] * (m(i) - m(i - 1));
 		}
-		unfit(k, f);
 
 		return v;
 	}
-	
+
+	// Static replication of a piecewise linear payoff built once and used for any number of
+	// put and call price vectors. Immutable after construction so it is safe to share across threads.
+	template<class X = double>
+	class replication {
+		std::vector<X> k; // strikes
+		std::vector<X> w; // jump in slope at k[i], w[0] = w[n - 1] = 0
+		X a, fa, ma;      // f(a), f'(a)
+		size_t ia;        // first index with k[i] >= a
+	public:
+		replication(std::span<const X> k_, std::span<const X> f_, X a)
+			: k(k_.begin(), k_.end()), w(f_.begin(), f_.end()), a(a)
+		{
+			size_t n = k.size();
+			ensure(n >= 2 and n == w.size());
+
+			std::tie(fa, ma) = carr_madan::tangent(a, std::span(k), std::span(w));
+			fit(std::span(k), std::span(w));
+			// (f[0], m[0], w[1], ..., w[n - 2]) => (0, w[1], ..., w[n - 2], 0)
+			for (size_t i = 0; i + 1 < n; ++i) {
+				w[i] = w[i + 1];
+			}
+			w[0] = 0;
+			w[n - 1] = 0;
+			ia = std::lower_bound(k.begin(), k.end(), a) - k.begin();
+		}
+		replication(const replication&) = default;
+		replication& operator=(const replication&) = default;
+		replication(replication&&) = default;
+		replication& operator=(replication&&) = default;
+		~replication()
+		{ }
+
+		size_t size() const
+		{
+			return k.size();
+		}
+		const X* strike() const
+		{
+			return k.data();
+		}
+		const X* weight() const
+		{
+			return w.data();
+		}
+		X separator() const
+		{
+			return a;
+		}
+		// first index using calls
+		size_t split() const
+		{
+			return ia;
+		}
+		// f(a) and f'(a)
+		std::pair<X, X> tangent() const
+		{
+			return { fa, ma };
+		}
+
+		// fa + ma (x - a) + sum_{k[i] < a} w[i] p[i] + sum_{k[i] >= a} w[i] c[i]
+		X value(X x, std::span<const X> p, std::span<const X> c) const
+		{
+			size_t n = k.size();
+			ensure(n == p.size() and n == c.size());
+
+			X v = fa + ma * (x - a);
+			for (size_t i = 1; i < ia and i < n - 1; ++i) {
+				v += w[i] * p[i];
+			}
+			for (size_t i = std::max<size_t>(ia, 1); i < n - 1; ++i) {
+				v += w[i] * c[i];
+			}
+
+			return v;
+		}
+	};
+
+	// Value r payoffs sharing strikes and separator against m snapshots of put and call prices.
+	// Snapshot j has forward x[j], puts p + j*n, calls c + j*n. Output v[i*m + j] for payoff i.
+	// Computed as a blocked matrix product of weights (r x n) and option prices (n x m).
+	template<class X = double>
+	inline void value(std::span<const replication<X>> R, std::span<const X> x, const X* p, const X* c, X* v)
+	{
+		constexpr size_t bi = 4, bj = 8; // block sizes
+		size_t r = R.size(), m = x.size();
+		if (r == 0 or m == 0) {
+			return;
+		}
+		size_t n = R[0].size();
+		size_t ia = R[0].split();
+		X a = R[0].separator();
+		for (const auto& R_ : R) {
+			ensure(R_.size() == n and R_.split() == ia and R_.separator() == a);
+		}
+
+		for (size_t i0 = 0; i0 < r; i0 += bi) {
+			size_t i1 = std::min(r, i0 + bi);
+			for (size_t j0 = 0; j0 < m; j0 += bj) {
+				size_t j1 = std::min(m, j0 + bj);
+				X acc[bi][bj] = { };
+				for (size_t l = 1; l + 1 < n; ++l) {
+					const X* o = l < ia ? p : c;
+					for (size_t i = i0; i < i1; ++i) {
+						X wl = R[i].weight()[l];
+						for (size_t j = j0; j < j1; ++j) {
+							acc[i - i0][j - j0] += wl * o[j * n + l];
+						}
+					}
+				}
+				for (size_t i = i0; i < i1; ++i) {
+					auto [fa, ma] = R[i].tangent();
+					for (size_t j = j0; j < j1; ++j) {
+						v[i * m + j] = fa + ma * (x[j] - a) + acc[i - i0][j - j0];
+					}
+				}
+			}
+		}
+	}
+
+	// Running Carr-Madan value updated one quote at a time.
+	// The weighted sum S = sum_{i < ia} w[i] p[i] + sum_{i >= ia} w[i] c[i] is updated in O(1) per quote.
+	// A Fenwick tree of d[i] = w[i](c[i] - p[i]) moves the separator in O(log n).
+	// S is recomputed from scratch every refresh updates to bound rounding drift.
+	template<class X = double>
+	class incremental {
+		std::vector<X> k, f, w; // strikes, payoff, slope jumps
+		std::vector<X> p, c;    // current puts and calls
+		std::vector<X> t;       // Fenwick tree of d, t[i - 1] = sum d[i - lsb(i), i)
+		X a, fa, ma, S;
+		size_t ia;              // first index using calls
+		size_t count, refresh;  // updates since last recompute
+
+		// d[i] += dd
+		void add(size_t i, X dd)
+		{
+			for (++i; i <= t.size(); i += i & (~i + 1)) {
+				t[i - 1] += dd;
+			}
+		}
+		// sum_{l < i} d[l]
+		X sum(size_t i) const
+		{
+			X s = 0;
+			for (; i > 0; i -= i & (~i + 1)) {
+				s += t[i - 1];
+			}
+
+			return s;
+		}
+		void tick()
+		{
+			if (++count >= refresh) {
+				recompute();
+			}
+		}
+	public:
+		incremental(std::span<const X> k_, std::span<const X> f_, X a,
+			std::span<const X> p_, std::span<const X> c_, size_t refresh = 1024)
+			: k(k_.begin(), k_.end()), f(f_.begin(), f_.end()), p(p_.begin(), p_.end()), c(c_.begin(), c_.end()),
+			  t(k_.size()), a(a), refresh(refresh)
+		{
+			size_t n = k.size();
+			ensure(n == p.size() and n == c.size());
+			ensure(refresh > 0);
+
+			replication<X> R(k_, f_, a);
+			w.assign(R.weight(), R.weight() + n);
+			std::tie(fa, ma) = R.tangent();
+			ia = R.split();
+			recompute();
+		}
+		incremental(const incremental&) = default;
+		incremental& operator=(const incremental&) = default;
+		incremental(incremental&&) = default;
+		incremental& operator=(incremental&&) = default;
+		~incremental()
+		{ }
+
+		size_t size() const
+		{
+			return k.size();
+		}
+		X separator() const
+		{
+			return a;
+		}
+
+		// O(n) rebuild of S and the Fenwick tree
+		incremental& recompute()
+		{
+			size_t n = k.size();
+			S = 0;
+			for (size_t i = 1; i < ia and i < n - 1; ++i) {
+				S += w[i] * p[i];
+			}
+			for (size_t i = std::max<size_t>(ia, 1); i < n - 1; ++i) {
+				S += w[i] * c[i];
+			}
+			// linear time Fenwick construction
+			for (size_t i = 0; i < n; ++i) {
+				t[i] = w[i] * (c[i] - p[i]);
+			}
+			for (size_t i = 1; i <= n; ++i) {
+				size_t j = i + (i & (~i + 1));
+				if (j <= n) {
+					t[j - 1] += t[i - 1];
+				}
+			}
+			count = 0;
+
+			return *this;
+		}
+
+		// p[i] = pi
+		incremental& put(size_t i, X pi)
+		{
+			ensure(i < k.size());
+			X dp = w[i] * (pi - p[i]);
+			if (i < ia) {
+				S += dp;
+			}
+			p[i] = pi;
+			add(i, -dp);
+			tick();
+
+			return *this;
+		}
+		// c[i] = ci
+		incremental& call(size_t i, X ci)
+		{
+			ensure(i < k.size());
+			X dc = w[i] * (ci - c[i]);
+			if (i >= ia) {
+				S += dc;
+			}
+			c[i] = ci;
+			add(i, dc);
+			tick();
+
+			return *this;
+		}
+		// Move the put/call separator. Strikes crossing a switch between puts and calls.
+		incremental& separator(X a_)
+		{
+			size_t ib = std::lower_bound(k.begin(), k.end(), a_) - k.begin();
+			if (ib > ia) {
+				S -= sum(ib) - sum(ia);
+			}
+			else if (ib < ia) {
+				S += sum(ia) - sum(ib);
+			}
+			a = a_;
+			ia = ib;
+			std::tie(fa, ma) = carr_madan::tangent(a, std::span(k), std::span(f));
+			tick();
+
+			return *this;
+		}
+
+		// fa + ma (x - a) + S
+		X value(X x) const
+		{
+			return fa + ma * (x - a) + S;
+		}
+	};
 
 } // namespace fms
\ No newline at end of file
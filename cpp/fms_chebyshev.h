@@ -0,0 +1,467 @@
+// fms_chebyshev.h - Chebyshev proxy surface on a box
+// p(x, y) = sum_{a < nx, b < ny} c[a, b] T_a(u(x)) T_b(v(y)), u, v map the box to [-1, 1]^2.
+// Coefficients are computed from values on Chebyshev nodes of the first kind.
+// A proxy is stored as a header followed by nx*ny doubles so a file can be mapped and used in place.
+#pragma once
+#include "ensure.h"
+#include "fms_crank_nicolson.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <limits>
+#include <numbers>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fms::chebyshev {
+
+	// maximum degree + 1 in each dimension
+	constexpr uint32_t max_size = 64;
+
+	// Chebyshev node j of n on [lo, hi]
+	inline double node(size_t j, size_t n, double lo, double hi)
+	{
+		double t = cos(std::numbers::pi * (j + 0.5) / n);
+
+		return (lo + hi) / 2 + t * (hi - lo) / 2;
+	}
+
+	// T_k(t) and T_k'(t) for k < n
+	inline void basis(double t, size_t n, double* T, double* dT)
+	{
+		T[0] = 1;
+		dT[0] = 0;
+		if (n > 1) {
+			T[1] = t;
+			dT[1] = 1;
+		}
+		for (size_t k = 2; k < n; ++k) {
+			T[k] = 2 * t * T[k - 1] - T[k - 2];
+			dT[k] = 2 * T[k - 1] + 2 * t * dT[k - 1] - dT[k - 2];
+		}
+	}
+
+	// binary layout of a proxy
+	struct header {
+		char magic[8];    // "FMSCHEB"
+		uint32_t version; // 1
+		uint32_t nx, ny;
+		uint32_t pad;
+		double x_lo, x_hi, y_lo, y_hi;
+		double sampled_error; // max |p - price| sampled on the check grid of build, not a bound
+	};
+	static_assert(sizeof(header) == 64);
+
+	// value and partial derivatives
+	struct value_dx_dy {
+		double value, dx, dy;
+	};
+
+	// Non-owning view of a header followed by coefficients.
+	class view {
+		const header* h;
+		const double* c;
+	public:
+		view(const void* p = nullptr)
+			: h(static_cast<const header*>(p)), c(h ? reinterpret_cast<const double*>(h + 1) : nullptr)
+		{ }
+		view(const view&) = default;
+		view& operator=(const view&) = default;
+		~view()
+		{ }
+
+		bool ok() const
+		{
+			return h and 0 == memcmp(h->magic, "FMSCHEB", 8) and h->version == 1
+				and 0 < h->nx and h->nx <= max_size and 0 < h->ny and h->ny <= max_size
+				and h->x_lo < h->x_hi and h->y_lo < h->y_hi;
+		}
+		explicit operator bool() const
+		{
+			return ok();
+		}
+		const header& info() const
+		{
+			return *h;
+		}
+		// coefficient of T_a T_b
+		double operator()(size_t a, size_t b) const
+		{
+			return c[a * h->ny + b];
+		}
+		bool contains(double x, double y) const
+		{
+			return h->x_lo <= x and x <= h->x_hi and h->y_lo <= y and y <= h->y_hi;
+		}
+
+		// p(x, y) and its partial derivatives using 2 nx*ny multiply-adds
+		value_dx_dy value(double x, double y) const;
+	};
+
+	// p(x, y) at fixed y as a series in x with row sums r[a] = sum_b c[a, b] T_b(v(y)).
+	// Building costs 2 nx*ny multiply-adds, each value after that 3 nx using Clenshaw,
+	// so a chain of strikes at one vol only pays for the row sums once.
+	class slice {
+		uint32_t n;
+		double x_lo, x_hi, su, dv;
+		bool in; // y in the box
+		double r[max_size], ry[max_size]; // row sums of c T_b(v) and c T_b'(v) dv/dy
+	public:
+		slice(const view& p, double y)
+			: n(p.info().nx), x_lo(p.info().x_lo), x_hi(p.info().x_hi), su(2 / (x_hi - x_lo)),
+			  dv(2 / (p.info().y_hi - p.info().y_lo)), in(p.info().y_lo <= y and y <= p.info().y_hi)
+		{
+			size_t ny = p.info().ny;
+			double v = (y - p.info().y_lo) * dv - 1;
+			double Tv[max_size], dTv[max_size];
+			basis(v, ny, Tv, dTv);
+			for (size_t a = 0; a < n; ++a) {
+				double s = 0, sy = 0;
+				for (size_t b = 0; b < ny; ++b) {
+					s += p(a, b) * Tv[b];
+					sy += p(a, b) * dTv[b];
+				}
+				r[a] = s;
+				ry[a] = sy * dv;
+			}
+		}
+
+		bool contains(double x) const
+		{
+			return in and x_lo <= x and x <= x_hi;
+		}
+
+		// p(x, y) and its partial derivatives
+		value_dx_dy value(double x) const
+		{
+			double u = (x - x_lo) * su - 1, u2 = 2 * u;
+			// b_a = r[a] + 2u b_{a+1} - b_{a+2}, d_a = db_a/du, e_a is b_a for ry
+			double b1 = 0, b2 = 0, d1 = 0, d2 = 0, e1 = 0, e2 = 0;
+			for (size_t a = n - 1; a > 0; --a) {
+				double b0 = r[a] + u2 * b1 - b2;
+				double d0 = 2 * b1 + u2 * d1 - d2;
+				double e0 = ry[a] + u2 * e1 - e2;
+				b2 = b1;
+				b1 = b0;
+				d2 = d1;
+				d1 = d0;
+				e2 = e1;
+				e1 = e0;
+			}
+
+			return { r[0] + u * b1 - b2, (b1 + u * d1 - d2) * su, ry[0] + u * e1 - e2 };
+		}
+	};
+
+	inline value_dx_dy view::value(double x, double y) const
+	{
+		return slice(*this, y).value(x);
+	}
+
+	// Owning proxy built from samples.
+	class proxy {
+		std::vector<double> buf; // header followed by coefficients, 8 byte aligned
+	public:
+		proxy()
+		{ }
+		// Sample price(x, y) on nx by ny Chebyshev nodes of the box and
+		// record the max error over a (check*nx + 1) by (check*ny + 1) uniform grid.
+		// The error is sampled, so |p - price| can be larger between grid points.
+		template<class Price>
+		proxy(Price price, uint32_t nx, uint32_t ny, double x_lo, double x_hi, double y_lo, double y_hi, uint32_t check = 2)
+			: buf(sizeof(header) / sizeof(double) + nx * ny)
+		{
+			ensure(0 < nx and nx <= max_size and 0 < ny and ny <= max_size);
+			ensure(x_lo < x_hi and y_lo < y_hi);
+
+			header& h = *reinterpret_cast<header*>(buf.data());
+			strcpy(h.magic, "FMSCHEB");
+			h.version = 1;
+			h.nx = nx;
+			h.ny = ny;
+			h.pad = 0;
+			h.x_lo = x_lo;
+			h.x_hi = x_hi;
+			h.y_lo = y_lo;
+			h.y_hi = y_hi;
+			h.sampled_error = 0;
+
+			// samples f[j, l] = price(x_j, y_l)
+			std::vector<double> f(nx * ny);
+			for (size_t l = 0; l < ny; ++l) {
+				double y = node(l, ny, y_lo, y_hi);
+				for (size_t j = 0; j < nx; ++j) {
+					f[j * ny + l] = price(node(j, nx, x_lo, x_hi), y);
+				}
+			}
+
+			// c[a, b] = (2/nx)(2/ny) sum_j sum_l f[j, l] T_a(t_j) T_b(t_l), halved for a = 0 or b = 0
+			// T_a(t_j) = cos(pi a (j + 1/2)/n)
+			std::vector<double> g(nx * ny); // transform in y
+			for (size_t j = 0; j < nx; ++j) {
+				for (size_t b = 0; b < ny; ++b) {
+					double s = 0;
+					for (size_t l = 0; l < ny; ++l) {
+						s += f[j * ny + l] * cos(std::numbers::pi * b * (l + 0.5) / ny);
+					}
+					g[j * ny + b] = s * (b == 0 ? 1. : 2.) / ny;
+				}
+			}
+			double* c = buf.data() + sizeof(header) / sizeof(double);
+			for (size_t a = 0; a < nx; ++a) {
+				for (size_t b = 0; b < ny; ++b) {
+					double s = 0;
+					for (size_t j = 0; j < nx; ++j) {
+						s += g[j * ny + b] * cos(std::numbers::pi * a * (j + 0.5) / nx);
+					}
+					c[a * ny + b] = s * (a == 0 ? 1. : 2.) / nx;
+				}
+			}
+
+			// max error on a grid that includes the box corners
+			view p(buf.data());
+			double err = 0;
+			for (size_t j = 0; j <= check * nx; ++j) {
+				double x = x_lo + (x_hi - x_lo) * j / (check * nx);
+				for (size_t l = 0; l <= check * ny; ++l) {
+					double y = y_lo + (y_hi - y_lo) * l / (check * ny);
+					err = std::max(err, fabs(p.value(x, y).value - price(x, y)));
+				}
+			}
+			h.sampled_error = err;
+		}
+		proxy(const proxy&) = default;
+		proxy& operator=(const proxy&) = default;
+		proxy(proxy&&) = default;
+		proxy& operator=(proxy&&) = default;
+		~proxy()
+		{ }
+
+		view operator*() const
+		{
+			return view(buf.data());
+		}
+		const void* data() const
+		{
+			return buf.data();
+		}
+		size_t bytes() const
+		{
+			return buf.size() * sizeof(double);
+		}
+
+		// Write the binary layout to path.
+		bool write(const char* path) const
+		{
+			FILE* fp = fopen(path, "wb");
+			if (!fp) {
+				return false;
+			}
+			size_t n = fwrite(data(), 1, bytes(), fp);
+			fclose(fp);
+
+			return n == bytes();
+		}
+	};
+
+	// Read-only memory map of a proxy file.
+	class mapped {
+		void* p = nullptr;
+		size_t n = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE, map = nullptr;
+#endif
+		void release()
+		{
+#ifdef _WIN32
+			if (p) UnmapViewOfFile(p);
+			if (map) CloseHandle(map);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+			map = nullptr;
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (p) munmap(p, n);
+#endif
+			p = nullptr;
+			n = 0;
+		}
+		bool ok() const
+		{
+			return p and n >= sizeof(header) and view(p).ok()
+				and n == sizeof(header) + sizeof(double) * view(p).info().nx * view(p).info().ny;
+		}
+	public:
+		mapped(const char* path)
+		{
+#ifdef _WIN32
+			file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			LARGE_INTEGER size;
+			if (file != INVALID_HANDLE_VALUE and GetFileSizeEx(file, &size)) {
+				n = static_cast<size_t>(size.QuadPart);
+				map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (map) {
+					p = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+				}
+			}
+#else
+			int fd = open(path, O_RDONLY);
+			struct stat st;
+			if (fd != -1 and fstat(fd, &st) == 0 and st.st_size > 0) {
+				n = static_cast<size_t>(st.st_size);
+				p = mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p == MAP_FAILED) {
+					p = nullptr;
+				}
+			}
+			if (fd != -1) {
+				close(fd);
+			}
+#endif
+			if (!ok()) {
+				release();
+			}
+			ensure(p);
+		}
+		mapped(const mapped&) = delete;
+		mapped& operator=(const mapped&) = delete;
+		~mapped()
+		{
+			release();
+		}
+
+		view operator*() const
+		{
+			return view(p);
+		}
+	};
+
+	// Put value P(f, s, k) = f p(log(k/f), s) from a proxy of p(x, s) = E[max{e^x - F, 0}], F = exp(sZ - s^2/2).
+	namespace put {
+
+		// value and derivatives with respect to f, s, and k
+		struct greeks {
+			double value, delta, vega, dual;
+		};
+
+		// NaN outside the box of the proxy.
+		inline greeks value(const slice& p, double f, double k)
+		{
+			double x = log(k / f);
+			if (!p.contains(x)) {
+				constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+				return { nan, nan, nan, nan };
+			}
+			auto [v, vx, vs] = p.value(x);
+
+			return { f * v, v - vx, f * vs, f * vx / k };
+		}
+		// Use a slice to value many strikes at the same vol.
+		inline greeks value(const view& p, double f, double s, double k)
+		{
+			return value(slice(p, s), f, k);
+		}
+
+		// Proxy of the American put on a unit forward over log strike [x_lo, x_hi] and vol [s_lo, s_hi]
+		// using a Crank-Nicolson grid with M nodes and N steps at each sample.
+		inline proxy american(uint32_t nx, uint32_t ns, double x_lo, double x_hi, double s_lo, double s_hi,
+			size_t M = 401, size_t N = 200)
+		{
+			auto price = [M, N](double x, double s) {
+				double k = exp(x);
+				return crank_nicolson::grid<>(s, M, N).value(1., [k](double F) { return std::max(k - F, 0.); }).value;
+			};
+
+			return proxy(price, nx, ns, x_lo, x_hi, s_lo, s_hi);
+		}
+
+	} // namespace put
+
+#ifdef _DEBUG
+	inline int test()
+	{
+		{
+			// exact for polynomials of low degree
+			auto q = [](double x, double y) { return 1 + x * x * y - 2 * y * y * y; };
+			proxy P(q, 4, 5, -1, 2, 0, 1);
+			view p = *P;
+			ensure(p.ok());
+			ensure(p.info().sampled_error < 1e-13);
+			auto [v, vx, vy] = p.value(0.5, 0.25);
+			ensure(fabs(v - q(0.5, 0.25)) < 1e-13);
+			ensure(fabs(vx - 2 * 0.5 * 0.25) < 1e-12);
+			ensure(fabs(vy - (0.5 * 0.5 - 6 * 0.25 * 0.25)) < 1e-12);
+		}
+		{
+			auto e = [](double x, double y) { return exp(x) * sin(y); };
+			proxy P(e, 16, 16, -0.5, 0.5, 0, 1);
+			ensure(P.write("chebyshev.bin"));
+			{
+				mapped M("chebyshev.bin");
+				view p = *M;
+				ensure(p.info().sampled_error < 1e-12);
+				ensure(p.info().sampled_error == (*P).info().sampled_error);
+				auto [v, vx, vy] = p.value(0.1, 0.3);
+				ensure(fabs(v - e(0.1, 0.3)) < 1e-12);
+				ensure(fabs(vx - e(0.1, 0.3)) < 1e-10);
+				ensure(fabs(vy - exp(0.1) * cos(0.3)) < 1e-10);
+			}
+			remove("chebyshev.bin");
+		}
+		{
+			proxy P = put::american(16, 12, -0.3, 0.3, 0.1, 0.4, 201, 100);
+			view p = *P;
+			ensure(p.info().sampled_error < 1e-3);
+			double f = 100, s = 0.2, k = 105;
+			auto [v, delta, vega, dual] = put::value(p, f, s, k);
+			// no early exercise premium without carry
+			ensure(fabs(v - black::normal::put::value(f, s, k)) < 1e-3 * f);
+			ensure(fabs(delta - black::normal::put::delta(f, s, k)) < 1e-2);
+			// a slice at s gives the same greeks
+			slice ps(p, s);
+			auto g = put::value(ps, f, k);
+			ensure(g.value == v and g.delta == delta and g.vega == vega and g.dual == dual);
+			// no extrapolation outside the box
+			ensure(std::isnan(put::value(p, f, s, 150).value));
+			ensure(std::isnan(put::value(p, f, 0.5, k).value));
+			ensure(!slice(p, 0.5).contains(0));
+		}
+		{
+			// row sums and Clenshaw agree with the tensor product basis
+			auto q = [](double x, double y) { return exp(x - y * y); };
+			proxy P(q, 7, 5, -1, 1, -1, 2);
+			view p = *P;
+			const auto& h = p.info();
+			for (double x : {-1., -0.3, 0.5, 1.}) {
+				for (double y : {-1., 0.2, 2.}) {
+					double Tu[7], dTu[7], Tv[5], dTv[5];
+					basis(x, 7, Tu, dTu);
+					basis((y - h.y_lo) * 2 / (h.y_hi - h.y_lo) - 1, 5, Tv, dTv);
+					double v = 0, vx = 0, vy = 0;
+					for (size_t a = 0; a < 7; ++a) {
+						for (size_t b = 0; b < 5; ++b) {
+							v += p(a, b) * Tu[a] * Tv[b];
+							vx += p(a, b) * dTu[a] * Tv[b];
+							vy += p(a, b) * Tu[a] * dTv[b] * 2 / 3;
+						}
+					}
+					auto [w, wx, wy] = p.value(x, y);
+					ensure(fabs(w - v) < 1e-14 and fabs(wx - vx) < 1e-13 and fabs(wy - vy) < 1e-13);
+				}
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fms::chebyshev
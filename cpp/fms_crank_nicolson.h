@@ -0,0 +1,265 @@
+// fms_crank_nicolson.h - Finite difference option pricing in log forward space
+// F = f exp(x), x = sB_1 - s^2/2 so V(x, w) satisfies dV/dw = (V_xx - V_x)/2 in variance time w = s^2 t.
+// Discretize x_i = (i - m) dx, 0 <= i < M = 2m + 1 and w in N steps of dw = s^2/N.
+// Crank-Nicolson (I - dw/2 L) V^{n+1} = (I + dw/2 L) V^n where L V_i = a V_{i-1} + b V_i + c V_{i+1}.
+// The first steps are replaced by twice as many implicit half steps (Rannacher) to damp the payoff kink.
+// Early exercise V >= phi(F) is solved exactly by a single Brennan-Schwartz sweep of the tridiagonal system.
+// Coefficients only depend on s, M, N and the width so one grid prices any forward and strike.
+#pragma once
+#include "ensure.h"
+#include "fms_black_normal.h"
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+namespace fms::crank_nicolson {
+
+	template<class X>
+	constexpr X NaN = std::numeric_limits<X>::quiet_NaN();
+
+	// value and greeks at the center of the grid
+	template<class X = double>
+	struct greeks {
+		X value, delta, gamma, vega;
+	};
+
+	template<class X = double>
+	class grid {
+		X s, dx, dw;
+		size_t M, N;
+		size_t rannacher; // number of implicit half steps replacing the first step
+		X a, b, c;        // L V_i = a V_{i-1} + b V_i + c V_{i+1}
+		// Elimination multipliers and pivots for (I - theta dw L), theta = 1/2 and 1.
+		// Down (call-like) eliminates from i = 1 up, up (put-like) from i = M - 2 down.
+		std::vector<X> md[2], pd[2], mu[2], pu[2];
+		// scratch
+		mutable std::vector<X> V, r, g;
+
+		// multipliers and inverse pivots for both sweep directions
+		void factor(X theta, X dt, std::vector<X>& md_, std::vector<X>& pd_, std::vector<X>& mu_, std::vector<X>& pu_)
+		{
+			X alpha = -theta * dt * a, beta = 1 - theta * dt * b, gamma = -theta * dt * c;
+
+			md_.assign(M, 0);
+			pd_.assign(M, 0);
+			X beta_ = beta;
+			pd_[1] = 1 / beta_;
+			for (size_t i = 2; i < M - 1; ++i) {
+				md_[i] = alpha * pd_[i - 1];
+				beta_ = beta - md_[i] * gamma;
+				pd_[i] = 1 / beta_;
+			}
+
+			mu_.assign(M, 0);
+			pu_.assign(M, 0);
+			beta_ = beta;
+			pu_[M - 2] = 1 / beta_;
+			for (size_t i = M - 3; i > 0; --i) {
+				mu_[i] = gamma * pu_[i + 1];
+				beta_ = beta - mu_[i] * alpha;
+				pu_[i] = 1 / beta_;
+			}
+		}
+
+		// V <- (I - theta dt L)^{-1} (I + (1 - theta) dt L) V subject to V >= g if american
+		void step(size_t k, X theta, X dt, bool american, bool put) const
+		{
+			X alpha = -theta * dt * a, gamma = -theta * dt * c;
+			X e = (1 - theta) * dt;
+
+			for (size_t i = 1; i < M - 1; ++i) {
+				r[i] = V[i] + e * (a * V[i - 1] + b * V[i] + c * V[i + 1]);
+			}
+			// Dirichlet boundary V_0 = g_0, V_{M-1} = g_{M-1}
+			V[0] = g[0];
+			V[M - 1] = g[M - 1];
+
+			if (put) {
+				// exercise region below: eliminate down from the top then substitute up applying the max
+				const X* m_ = mu[k].data();
+				const X* p_ = pu[k].data();
+				r[M - 2] -= gamma * V[M - 1];
+				for (size_t i = M - 3; i > 0; --i) {
+					r[i] -= m_[i] * r[i + 1];
+				}
+				for (size_t i = 1; i < M - 1; ++i) {
+					V[i] = (r[i] - alpha * V[i - 1]) * p_[i];
+					if (american and g[i] > V[i]) {
+						V[i] = g[i];
+					}
+				}
+			}
+			else {
+				// exercise region above: eliminate up from the bottom then substitute down applying the max
+				const X* m_ = md[k].data();
+				const X* p_ = pd[k].data();
+				r[1] -= alpha * V[0];
+				for (size_t i = 2; i < M - 1; ++i) {
+					r[i] -= m_[i] * r[i - 1];
+				}
+				for (size_t i = M - 2; i > 0; --i) {
+					V[i] = (r[i] - gamma * V[i + 1]) * p_[i];
+					if (american and g[i] > V[i]) {
+						V[i] = g[i];
+					}
+				}
+			}
+		}
+	public:
+		// M = 2m + 1 space nodes over log moneyness [-width s, width s], N time steps.
+		grid(X s, size_t M = 401, size_t N = 200, X width = 6, size_t rannacher = 4)
+			: s(s), M(M | 1), N(N), rannacher(rannacher)
+		{
+			ensure(s > 0);
+			ensure(this->M >= 5 and N > 0);
+			ensure(width > 0);
+			ensure(rannacher % 2 == 0 and N >= rannacher / 2);
+
+			dx = 2 * width * std::max(s, X(0.05)) / (this->M - 1);
+			dw = s * s / N;
+			// (V_xx - V_x)/2 with central differences
+			a = (1 / (dx * dx) + 1 / (2 * dx)) / 2;
+			b = -1 / (dx * dx);
+			c = (1 / (dx * dx) - 1 / (2 * dx)) / 2;
+
+			factor(X(0.5), dw, md[0], pd[0], mu[0], pu[0]);
+			factor(X(1), rannacher ? dw / (rannacher / 2) : dw, md[1], pd[1], mu[1], pu[1]);
+
+			V.resize(this->M);
+			r.resize(this->M);
+			g.resize(this->M);
+		}
+		grid(const grid&) = default;
+		grid& operator=(const grid&) = default;
+		~grid()
+		{ }
+
+		size_t size() const
+		{
+			return M;
+		}
+		// F_i = f exp(x_i)
+		X node(size_t i) const
+		{
+			return (X(i) - X(M / 2)) * dx;
+		}
+
+		// Value and greeks of max_tau E[phi(F_tau)] (american) or E[phi(F_1)] at forward f.
+		// Not thread safe: the grid owns its scratch buffers.
+		template<class Phi>
+		greeks<X> value(X f, Phi phi, bool american = true) const
+		{
+			ensure(f > 0);
+
+			for (size_t i = 0; i < M; ++i) {
+				X x = node(i);
+				g[i] = phi(f * exp(x));
+				// cell average of the payoff to smooth kinks between nodes
+				V[i] = (phi(f * exp(x - dx / 2)) + 4 * g[i] + phi(f * exp(x + dx / 2))) / 6;
+				if (american and g[i] > V[i]) {
+					V[i] = g[i];
+				}
+			}
+			bool put = g[0] > g[M - 1];
+
+			size_t m = M / 2;
+			X V_ = V[m]; // center value before the last step
+			size_t k = 0, n = 0;
+			X theta = 0.5, dt_ = dw;
+			if (rannacher) {
+				// replace the first rannacher/2 steps by rannacher implicit half steps
+				k = 1;
+				theta = 1;
+				dt_ = dw / (rannacher / 2);
+				for (size_t j = 0; j < rannacher; ++j) {
+					V_ = V[m];
+					step(k, theta, dt_, american, put);
+				}
+				n = rannacher / 2;
+			}
+			for (; n < N; ++n) {
+				V_ = V[m];
+				k = 0;
+				theta = 0.5;
+				dt_ = dw;
+				step(k, theta, dw, american, put);
+			}
+
+			X V0 = V[m];
+			X Vx = (V[m + 1] - V[m - 1]) / (2 * dx);
+			X Vxx = (V[m + 1] - 2 * V0 + V[m - 1]) / (dx * dx);
+			// one more step of the same kind for a central difference dV/ds = 2 s dV/dw
+			step(k, theta, dt_, american, put);
+			X Vw = (V[m] - V_) / (2 * dt_);
+
+			return { V0, Vx / f, (Vxx - Vx) / (f * f), 2 * s * Vw };
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test_grid()
+	{
+		double f = 100, s = 0.2, k = 100;
+		auto put = [k](double x) { return std::max(k - x, 0.); };
+		auto call = [k](double x) { return std::max(x - k, 0.); };
+		// Black put value, delta, gamma, and vega
+		auto p = [f, k](double f_, double s_) { return black::normal::put::value(f_, s_, k); };
+		double v = p(f, s);
+		double h = 1e-3;
+		double delta = (p(f + h, s) - p(f - h, s)) / (2 * h);
+		double gamma = (p(f + h, s) - 2 * v + p(f - h, s)) / (h * h);
+		double vega = (p(f, s + h) - p(f, s - h)) / (2 * h);
+
+		grid<> G(s, 801, 400);
+		{
+			auto [v_, delta_, gamma_, vega_] = G.value(f, put, false);
+			ensure(fabs(v_ - v) < 1e-4);
+			ensure(fabs(delta_ - delta) < 1e-4);
+			ensure(fabs(gamma_ - gamma) < 1e-4);
+			ensure(fabs(vega_ - vega) < 1e-3);
+		}
+		{
+			// no early exercise premium without carry
+			auto [v_, delta_, gamma_, vega_] = G.value(f, put, true);
+			ensure(fabs(v_ - v) < 1e-4);
+			ensure(fabs(vega_ - vega) < 1e-3);
+			ensure(fabs(G.value(f, call, true).value - (v + f - k)) < 1e-4);
+		}
+		{
+			// reuse the grid for other forwards and strikes
+			for (double k_ : {80., 90., 110., 120.}) {
+				auto put_ = [k_](double x) { return std::max(k_ - x, 0.); };
+				double v_ = G.value(f, put_).value;
+				ensure(fabs(v_ - black::normal::put::value(f, s, k_)) < 1e-4);
+				// homogeneous payoffs: V(f, k) = k V(f/k, 1)
+				auto put1 = [](double x) { return std::max(1 - x, 0.); };
+				ensure(fabs(v_ - k_ * G.value(f / k_, put1).value) < 1e-10);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+	namespace european {
+
+		template<class Phi, class X = double>
+		inline X value(X f, X s, Phi phi, size_t M = 401, size_t N = 200)
+		{
+			return grid<X>(s, M, N).value(f, phi, false).value;
+		}
+
+	} // namespace european
+
+	namespace american {
+
+		// Return max_tau E[phi(F_tau)] using the same arguments as binomial::american::value.
+		template<class Phi, class X = double>
+		inline X value(X f, X s, Phi phi, size_t M = 401, size_t N = 200)
+		{
+			return grid<X>(s, M, N).value(f, phi, true).value;
+		}
+
+	} // namespace american
+
+} // namespace fms::crank_nicolson
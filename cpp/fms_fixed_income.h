@@ -1,8 +1,12 @@
 // fms_fixed_income.h - Fixed Income instrument interface class
 #pragma once
 #include "ensure.h"
+#include "fms_small_vector.h"
+#include <cmath>
 #include <algorithm>
-#include <map>
+#include <functional>
+#include <span>
+#include <utility>
 #include <vector>
 
 namespace fms::fixed_income {
@@ -85,17 +89,23 @@ namespace fms::fixed_income {
 	};
 
 	// instrument value type
-	template<class U = double, class C = double>
+	// Cash flows are stored in std::vector if N == 0, otherwise up to N are stored in place.
+	template<class U = double, class C = double, size_t N = 0>
 	class instrument_value : public instrument<U, C>
 	{
-		std::vector<U> u;
-		std::vector<C> c;
+		storage<U, N> u;
+		storage<C, N> c;
 	public:
 		instrument_value()
 		{ }
 		instrument_value(size_t n, const U* u, const C* c)
 			: u(u, u + n), c(c, c + n)
 		{ }
+		instrument_value(std::vector<U>&& u, std::vector<C>&& c)
+			: u(std::move(u)), c(std::move(c))
+		{
+			ensure(this->u.size() == this->c.size());
+		}
 		instrument_value(const std::initializer_list<U>& u, const std::initializer_list<C>& c)
 			: u(u.begin(), u.end()), c(c.begin(), c.end())
 		{
@@ -128,7 +138,7 @@ namespace fms::fixed_income {
 
 		instrument<U, C>& extend(U u_, C c_)
 		{
-			ensure(u_ > u.back());
+			ensure(u.empty() or u_ > u.back());
 
 			u.push_back(u_);
 			c.push_back(c_);
@@ -155,29 +165,154 @@ namespace fms::fixed_income {
 		{ }
 	};
 
-	// Collection of weighted instruments with cash flows sorted by time
-	// If n == 1 this sorts by increasing time.
+	// Merge weighted sorted cash flows into u and c netting equal times. Return number of flows.
+	// Ties take a before b.
 	template<class U = double, class C = double>
-	inline instrument_value<U, C> portfolio(size_t n, const C* w, const instrument<U, C>* i)
+	inline size_t merge(size_t na, const U* ua, const C* ca, C wa, size_t nb, const U* ub, const C* cb, C wb, U* u, C* c)
 	{
-		std::map<U, C> wi;
+		size_t i = 0, j = 0, k = 0;
+		auto put = [u, c, &k](U u_, C c_) {
+			if (k and u[k - 1] == u_) {
+				c[k - 1] += c_;
+			}
+			else {
+				u[k] = u_;
+				c[k] = c_;
+				++k;
+			}
+		};
+		while (i < na and j < nb) {
+			if (ua[i] <= ub[j]) {
+				put(ua[i], wa * ca[i]);
+				++i;
+			}
+			else {
+				put(ub[j], wb * cb[j]);
+				++j;
+			}
+		}
+		for (; i < na; ++i) {
+			put(ua[i], wa * ca[i]);
+		}
+		for (; j < nb; ++j) {
+			put(ub[j], wb * cb[j]);
+		}
 
+		return k;
+	}
+
+	// Collection of weighted instruments with cash flows sorted by time.
+	// Cash flows of each instrument must be nondecreasing in time.
+	// Instruments are merged pairwise into flat buffers, netting equal times at each level,
+	// so later levels shrink to the number of distinct times.
+	template<class U = double, class C = double>
+	inline instrument_value<U, C> portfolio(size_t n, const C* w, const instrument<U, C>* const* i)
+	{
+		size_t m = 0;
 		for (size_t j = 0; j < n; ++j) {
-			const auto ij = i[j];
-			const U* iju = ij.time();
-			const C* ijc = ij.cash();
-			for (size_t k = 0; k < ij.size(); ++k) {
-				wi[iju[k]] += w[j] * ijc[k];
-			}
+			const U* u = i[j]->time();
+			ensure(std::is_sorted(u, u + i[j]->size()));
+			m += i[j]->size();
 		}
+		// ping-pong buffers and run offsets
+		std::vector<U> u(m), u_(m);
+		std::vector<C> c(m), c_(m);
+		std::vector<size_t> o{ 0 }, o_;
+		o.reserve(n / 2 + 2);
+		o_.reserve(n / 2 + 2);
 
-		instrument_value<U, C> iv;
-		for (const auto& [u, c] : wi) {
-			iv.extend(u, c);
+		for (size_t j = 0; j < n; j += 2) {
+			size_t k = o.back();
+			if (j + 1 < n) {
+				k += merge(i[j]->size(), i[j]->time(), i[j]->cash(), w[j],
+					i[j + 1]->size(), i[j + 1]->time(), i[j + 1]->cash(), w[j + 1], u.data() + k, c.data() + k);
+			}
+			else {
+				k += merge(i[j]->size(), i[j]->time(), i[j]->cash(), w[j], 0, u.data(), c.data(), C(0), u.data() + k, c.data() + k);
+			}
+			o.push_back(k);
 		}
+		while (o.size() > 2) {
+			o_.assign(1, 0);
+			for (size_t r = 0; r + 1 < o.size(); r += 2) {
+				size_t a = o[r], b = o[r + 1], e = r + 2 < o.size() ? o[r + 2] : b;
+				size_t k = o_.back();
+				k += merge(b - a, u.data() + a, c.data() + a, C(1), e - b, u.data() + b, c.data() + b, C(1), u_.data() + k, c_.data() + k);
+				o_.push_back(k);
+			}
+			std::swap(u, u_);
+			std::swap(c, c_);
+			std::swap(o, o_);
+		}
+		u.resize(o.back());
+		c.resize(o.back());
 
-		return iv;
+		return instrument_value<U, C>(std::move(u), std::move(c));
+	}
+	template<class U = double, class C = double>
+	inline instrument_value<U, C> portfolio(std::span<const C> w, std::span<const instrument<U, C>* const> i)
+	{
+		ensure(w.size() == i.size());
+
+		return portfolio(i.size(), w.data(), i.data());
 	}
 
+#ifdef _DEBUG
+	inline int portfolio_test()
+	{
+		instrument_value<> a({ 0, 1, 2 }, { -1, 0.1, 1.1 });
+		instrument_value<> b({ 1, 1.5, 2, 3 }, { 1, 2, 3, 4 });
+		instrument_value<> e;
+		{
+			const instrument<>* i[] = { &a, &e, &b };
+			double w[] = { 2, 5, -1 };
+			auto p = portfolio(3, w, i);
+			ensure(p.size() == 5);
+			double u[] = { 0, 1, 1.5, 2, 3 };
+			double c[] = { -2, 0.2 - 1, -2, 2.2 - 3, -4 };
+			for (size_t j = 0; j < 5; ++j) {
+				ensure(p.time()[j] == u[j]);
+				ensure(fabs(p.cash()[j] - c[j]) < 1e-15);
+			}
+		}
+		{
+			// equal times within an instrument are netted
+			instrument_value<> d({ 1, 1, 2 }, { 1, 2, 3 });
+			const instrument<>* i[] = { &d };
+			double w[] = { 1 };
+			auto p = portfolio(std::span<const double>(w), std::span<const instrument<>* const>(i));
+			ensure(p.size() == 2 and p.time()[0] == 1 and p.cash()[0] == 3 and p.cash()[1] == 3);
+		}
+		{
+			auto p = portfolio<double, double>(0, nullptr, nullptr);
+			ensure(p.size() == 0);
+		}
+		{
+			// trailing empty instruments and all empty instruments
+			const instrument<>* i[] = { &a, &b, &e, &e, &e };
+			double w[] = { 1, 1, 1, 1, 1 };
+			for (size_t n : {3, 4, 5}) {
+				auto p = portfolio(n, w, i);
+				ensure(p.size() == 5 and p.time()[4] == 3 and p.cash()[4] == 4);
+			}
+			const instrument<>* j[] = { &e, &e, &e };
+			for (size_t n : {1, 2, 3}) {
+				ensure(portfolio(n, w, j).size() == 0);
+			}
+		}
+		{
+			// inline storage spilling to heap
+			instrument_value<double, double, 2> d({ 1, 2 }, { 1, 2 });
+			d.extend(3, 3);
+			instrument_value<double, double, 2> d2(std::move(d));
+			const instrument<>* i[] = { &d2, &b };
+			double w[] = { 1, 1 };
+			auto p = portfolio(2, w, i);
+			ensure(p.size() == 4 and p.cash()[0] == 2 and p.cash()[2] == 5 and p.cash()[3] == 7);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
 
 } // namespace fms::fixed_income
\ No newline at end of file
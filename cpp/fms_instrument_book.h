@@ -0,0 +1,333 @@
+// fms_instrument_book.h - Many instruments in contiguous time and cash arrays
+// Instrument j has cash flows o[j] <= k < o[j + 1] of u and c.
+// A reserved book takes storage from a monotonic arena with one upstream allocation.
+// An unreserved book grows vectors on the upstream resource so outgrown buffers are freed.
+// A schedule of the distinct cash flow times lets a book be valued with one discount per time.
+#pragma once
+#include "ensure.h"
+#include "fms_fixed_income.h"
+#include "fms_pwflat.h"
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace fms::fixed_income {
+
+	template<class U = double, class C = double>
+	class instrument_book {
+		std::pmr::monotonic_buffer_resource arena;
+		std::pmr::vector<U> u;
+		std::pmr::vector<C> c;
+		std::pmr::vector<size_t> o;
+	public:
+		// Reserve space for n instruments with m cash flows in total.
+		// Growing past the reservation keeps the outgrown buffers in the arena until the book is destroyed.
+		instrument_book(size_t n = 0, size_t m = 0, std::pmr::memory_resource* r = std::pmr::get_default_resource())
+			: arena(m * (sizeof(U) + sizeof(C)) + (n + 1) * sizeof(size_t) + 64, r),
+			  u(n or m ? &arena : r), c(n or m ? &arena : r), o(n or m ? &arena : r)
+		{
+			u.reserve(m);
+			c.reserve(m);
+			o.reserve(n + 1);
+			o.push_back(0);
+		}
+		// views point into the arena
+		instrument_book(const instrument_book&) = delete;
+		instrument_book& operator=(const instrument_book&) = delete;
+		~instrument_book()
+		{ }
+
+		// number of instruments
+		size_t size() const
+		{
+			return o.size() - 1;
+		}
+		// number of cash flows
+		size_t flows() const
+		{
+			return u.size();
+		}
+		const U* time() const
+		{
+			return u.data();
+		}
+		const C* cash() const
+		{
+			return c.data();
+		}
+		// n + 1 offsets
+		const size_t* offset() const
+		{
+			return o.data();
+		}
+
+		// Append instrument with nondecreasing times.
+		instrument_book& add(size_t m, const U* u_, const C* c_)
+		{
+			ensure(std::is_sorted(u_, u_ + m));
+
+			u.insert(u.end(), u_, u_ + m);
+			c.insert(c.end(), c_, c_ + m);
+			o.push_back(u.size());
+
+			return *this;
+		}
+		instrument_book& add(const instrument<U, C>& i)
+		{
+			return add(i.size(), i.time(), i.cash());
+		}
+
+		// non-owning view of instrument j
+		instrument_ptr<U, C> operator[](size_t j) const
+		{
+			return instrument_ptr<U, C>(o[j + 1] - o[j], u.data() + o[j], c.data() + o[j]);
+		}
+	};
+
+	// pv[j] is the present value of instrument j of the book.
+	// One pass over the flat arrays walking the curve knots within each instrument.
+	template<class U = double, class C = double, class T = double, class F = double, size_t N = 0>
+	inline void present_value(const instrument_book<U, C>& b, const pwflat::curve<T, F, N>& f, std::span<F> pv)
+	{
+		ensure(pv.size() == b.size());
+
+		const U* u = b.time();
+		const C* c = b.cash();
+		const size_t* o = b.offset();
+		for (size_t j = 0; j < b.size(); ++j) {
+			pwflat::walk<T, F> w(f.size(), f.time(), f.forward(), f.extrapolate(), f.prefix());
+			F s = 0;
+			for (size_t k = o[j]; k < o[j + 1]; ++k) {
+				s += c[k] * exp(-w(u[k]));
+			}
+			pv[j] = s;
+		}
+	}
+
+	// Distinct sorted cash flow times of a book and the index of each cash flow time.
+	// Build once per book and reuse for every curve.
+	template<class U = double>
+	class schedule {
+		std::vector<U> t;
+		std::vector<uint32_t> i;
+	public:
+		template<class C>
+		schedule(const instrument_book<U, C>& b)
+			: i(b.flows())
+		{
+			const U* u = b.time();
+			const size_t* o = b.offset();
+			// union of sorted instrument times merged pairwise
+			std::vector<U> t_;
+			std::vector<size_t> r(o, o + b.size() + 1), r_;
+			t.assign(u, u + b.flows());
+			t_.resize(t.size());
+			while (r.size() > 2) {
+				r_.assign(1, 0);
+				for (size_t k = 0; k + 1 < r.size(); k += 2) {
+					size_t e = k + 2 < r.size() ? r[k + 2] : r[k + 1];
+					auto l = std::set_union(t.begin() + r[k], t.begin() + r[k + 1], t.begin() + r[k + 1], t.begin() + e, t_.begin() + r_.back());
+					r_.push_back(l - t_.begin());
+				}
+				std::swap(t, t_);
+				std::swap(r, r_);
+			}
+			t.resize(r.back());
+			t.erase(std::unique(t.begin(), t.end()), t.end());
+			ensure(t.size() <= UINT32_MAX);
+			size_t d = t.size();
+			for (size_t j = 0; j < b.size(); ++j) {
+				// instrument times are sorted so gallop from the previous index, t[m] < u[k] for m < l
+				size_t l = 0;
+				for (size_t k = o[j]; k < o[j + 1]; ++k) {
+					size_t h = 1;
+					while (l + h < d and t[l + h - 1] < u[k]) {
+						l += h;
+						h *= 2;
+					}
+					l = std::lower_bound(t.begin() + l, t.begin() + std::min(d, l + h), u[k]) - t.begin();
+					i[k] = static_cast<uint32_t>(l);
+				}
+			}
+		}
+
+		size_t size() const
+		{
+			return t.size();
+		}
+		const U* time() const
+		{
+			return t.data();
+		}
+		// index into time() of each cash flow
+		const uint32_t* index() const
+		{
+			return i.data();
+		}
+	};
+
+	// Pairwise sum of x. The order of additions only depends on x.size().
+	template<class F>
+	inline F sum(std::span<const F> x)
+	{
+		if (x.size() <= 8) {
+			F s = 0;
+			for (F x_ : x) {
+				s += x_;
+			}
+
+			return s;
+		}
+		size_t h = x.size() / 2;
+
+		return sum(x.first(h)) + sum(x.subspan(h));
+	}
+
+	// pv[j] is the present value of instrument j of the book, return the total.
+	// Discounts are computed once at the schedule times by walking the curve knots,
+	// then chunks of instruments are summed on a pool of threads.
+	// Each pv[j] is summed by one thread in cash flow order and the total is a pairwise sum
+	// so results do not depend on the number of threads.
+	template<class U = double, class C = double, class T = double, class F = double, size_t N = 0>
+	inline F present_value(const instrument_book<U, C>& b, const schedule<U>& s, const pwflat::curve<T, F, N>& f,
+		std::span<F> pv, size_t threads = 0)
+	{
+		ensure(pv.size() == b.size());
+
+		std::vector<F> D(s.size());
+		f.discount(std::span<const U>(s.time(), s.size()), std::span<F>(D));
+
+		size_t n = b.size();
+		if (threads == 0) {
+			threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+		}
+		constexpr size_t chunk = 4096; // instruments per grab
+		threads = std::min(threads, (n + chunk - 1) / chunk);
+
+		std::atomic<size_t> next = 0;
+		auto work = [&, n]() {
+			const C* c = b.cash();
+			const size_t* o = b.offset();
+			const uint32_t* i = s.index();
+			for (size_t j0 = next.fetch_add(chunk); j0 < n; j0 = next.fetch_add(chunk)) {
+				for (size_t j = j0; j < std::min(n, j0 + chunk); ++j) {
+					F v = 0;
+					for (size_t k = o[j]; k < o[j + 1]; ++k) {
+						v += c[k] * D[i[k]];
+					}
+					pv[j] = v;
+				}
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (size_t k = 1; k < threads; ++k) {
+			pool.emplace_back(work);
+		}
+		work();
+		for (auto& th : pool) {
+			th.join();
+		}
+
+		return sum(std::span<const F>(pv));
+	}
+
+#ifdef _DEBUG
+	inline int instrument_book_test()
+	{
+		instrument_book<> b(3, 7);
+		b.add(cash_deposit<>(0.5, 0.03));
+		b.add(instrument_value<>({ 0, 1, 2, 3 }, { -1, 0.04, 0.04, 1.04 }));
+		b.add(instrument_value<>{});
+		b.add(forward_rate_agreement<>(1, 1.5, 0.035));
+		ensure(b.size() == 4 and b.flows() == 8);
+		ensure(b[2].size() == 0);
+		ensure(b[1].size() == 4 and b[1].time()[3] == 3 and b[1].cash()[3] == 1.04);
+		ensure(b[3].effective() == 1 and b[3].termination() == 1.5);
+
+		double t[] = { 1, 2, 5 }, f[] = { 0.03, 0.035, 0.04 };
+		pwflat::curve<> g(3, t, f, 0.045);
+		double pv[4];
+		present_value(b, g, std::span<double>(pv));
+		for (size_t j = 0; j < b.size(); ++j) {
+			auto i = b[j];
+			double v = 0;
+			for (size_t k = 0; k < i.size(); ++k) {
+				v += i.cash()[k] * g.discount(i.time()[k]);
+			}
+			ensure(fabs(pv[j] - v) < 1e-15);
+		}
+
+		schedule<> S(b);
+		ensure(S.size() == 6); // 0, 0.5, 1, 1.5, 2, 3
+		double pv2[4];
+		double s = present_value(b, S, g, std::span<double>(pv2));
+		for (size_t j = 0; j < b.size(); ++j) {
+			ensure(fabs(pv2[j] - pv[j]) < 1e-15);
+		}
+		ensure(s == pv2[0] + pv2[1] + pv2[2] + pv2[3]);
+
+		// identical results for any number of threads
+		instrument_book<> B;
+		for (int k = 0; k < 10'000; ++k) {
+			B.add(instrument_value<>({ 0, 0.5 + k % 7, 7.5 + k % 11 }, { -1, 0.01 * (k % 5), 1 }));
+		}
+		schedule<> SB(B);
+		std::vector<double> p1(B.size()), p3(B.size());
+		double s1 = present_value(B, SB, g, std::span<double>(p1), 1);
+		double s3 = present_value(B, SB, g, std::span<double>(p3), 3);
+		ensure(s1 == s3 and p1 == p3);
+
+		{
+			// upstream allocations and bytes in use
+			struct counting : std::pmr::memory_resource {
+				size_t calls = 0, bytes = 0;
+				void* do_allocate(size_t n, size_t a) override
+				{
+					++calls;
+					bytes += n;
+					return std::pmr::new_delete_resource()->allocate(n, a);
+				}
+				void do_deallocate(void* p, size_t n, size_t a) override
+				{
+					bytes -= n;
+					std::pmr::new_delete_resource()->deallocate(p, n, a);
+				}
+				bool do_is_equal(const std::pmr::memory_resource& r) const noexcept override
+				{
+					return this == &r;
+				}
+			};
+			double u[] = { 0, 1, 2 }, c[] = { -1, 0.03, 1.03 };
+			size_t n = 10'000, m = 3 * n;
+			counting r;
+			{
+				// one upstream allocation if reserved
+				instrument_book<> b(n, m, &r);
+				for (size_t j = 0; j < n; ++j) {
+					b.add(3, u, c);
+				}
+				ensure(r.calls == 1);
+			}
+			ensure(r.bytes == 0);
+			{
+				// outgrown buffers are freed if not reserved
+				instrument_book<> b(0, 0, &r);
+				for (size_t j = 0; j < n; ++j) {
+					b.add(3, u, c);
+				}
+				ensure(r.bytes <= 2 * (m * 2 * sizeof(double) + (n + 1) * sizeof(size_t)));
+			}
+			ensure(r.bytes == 0);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fms::fixed_income
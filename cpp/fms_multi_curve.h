@@ -0,0 +1,347 @@
+// fms_multi_curve.h - Bootstrap discount and projection curves
+// An instrument has fixed cash flows c[l] at u[l] discounted by curve d and an optional floating leg
+// paying w (P_p(t[j-1])/P_p(t[j]) - 1) at t[j] where P_p is the discount of projection curve p.
+// OIS swaps have p = d and tenor swaps have p != d.
+// Instrument i extends curve p if it has a floating leg and p != d, otherwise curve d.
+// Curves are solved in dependency order so every other curve an instrument uses is complete.
+// Integrals of complete curves at all times used by later instruments are computed once and shared.
+#pragma once
+#include "ensure.h"
+#include "fms_pwflat.h"
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <vector>
+#ifdef _DEBUG
+#include "fms_bootstrap.h"
+#endif
+
+namespace fms::multi_curve {
+
+	template<class U = double, class C = double>
+	struct instrument {
+		std::vector<U> u; // fixed cash flow times
+		std::vector<C> c; // fixed cash flows
+		std::vector<U> t; // floating reset and payment times
+		C w;              // floating notional
+		size_t d, p;      // discount and projection curve
+		C price;
+
+		// curve this instrument extends
+		size_t target() const
+		{
+			return t.size() > 1 and p != d ? p : d;
+		}
+		U termination() const
+		{
+			U T = u.size() ? u.back() : 0;
+
+			return t.size() ? std::max(T, t.back()) : T;
+		}
+	};
+
+	// Integrals and discounts of a complete curve at sorted times.
+	template<class T = double, class F = double>
+	class cache {
+		std::vector<T> u, u_; // sorted unique times and scratch
+		std::vector<F> I, D;
+	public:
+		// merge sorted times, instruments mostly share times so u stays short
+		void add(std::span<const T> v)
+		{
+			u_.clear();
+			std::set_union(u.begin(), u.end(), v.begin(), v.end(), std::back_inserter(u_));
+			std::swap(u, u_);
+		}
+		void compute(const pwflat::curve<T, F>& f)
+		{
+			I.resize(u.size());
+			D.resize(u.size());
+			f.integral(std::span<const T>(u), std::span<F>(I));
+			for (size_t i = 0; i < u.size(); ++i) {
+				D[i] = exp(-I[i]);
+			}
+		}
+
+		// Lookup for nondecreasing times that must have been added.
+		class cursor {
+			const cache* c;
+			size_t i;
+		public:
+			cursor(const cache& c)
+				: c(&c), i(0)
+			{ }
+			// index of u_
+			size_t operator()(T u_)
+			{
+				while (i < c->u.size() and c->u[i] < u_) {
+					++i;
+				}
+				ensure(i < c->u.size() and c->u[i] == u_);
+
+				return i;
+			}
+			F integral(T u_)
+			{
+				return c->I[(*this)(u_)];
+			}
+			F discount(T u_)
+			{
+				return c->D[(*this)(u_)];
+			}
+		};
+	};
+
+	// Build n curves from instruments sorted by termination for each target curve.
+	template<class U = double, class C = double, class T = double, class F = double>
+	inline std::vector<pwflat::curve<T, F>> build(size_t n, std::span<const instrument<U, C>> is)
+	{
+		std::vector<pwflat::curve<T, F>> f(n);
+		std::vector<cache<T, F>> caches(n);
+
+		// a depends on b if an instrument extending a uses b
+		std::vector<char> dep(n * n, 0);
+		for (const auto& i : is) {
+			ensure(i.d < n and i.p < n);
+			ensure(i.u.size() == i.c.size());
+			size_t a = i.target();
+			for (size_t b : {i.d, i.p}) {
+				if (b != a) {
+					dep[a * n + b] = 1;
+				}
+			}
+		}
+		// dependency order
+		std::vector<size_t> order;
+		std::vector<char> done(n, 0);
+		while (order.size() < n) {
+			size_t m = order.size();
+			for (size_t a = 0; a < n; ++a) {
+				if (done[a]) {
+					continue;
+				}
+				bool ready = true;
+				for (size_t b = 0; b < n; ++b) {
+					ready = ready and (!dep[a * n + b] or done[b]);
+				}
+				if (ready) {
+					order.push_back(a);
+					done[a] = 1;
+				}
+			}
+			ensure(order.size() > m || !"multi_curve::build: circular curve dependency");
+		}
+
+		// times each curve is evaluated at by instruments extending other curves
+		for (const auto& i : is) {
+			size_t a = i.target();
+			if (i.d != a) {
+				caches[i.d].add(std::span<const U>(i.u));
+				caches[i.d].add(std::span<const U>(i.t));
+			}
+			if (i.t.size() > 1 and i.p != a) {
+				caches[i.p].add(std::span<const U>(i.t));
+			}
+		}
+
+		for (size_t a : order) {
+			auto& fa = f[a];
+			for (const auto& i : is) {
+				if (i.target() != a) {
+					continue;
+				}
+				T t_ = fa.size() ? fa.back().first : 0;
+				T u_ = i.termination();
+				ensure(u_ > t_);
+				F I_ = fa.integral(t_);
+				bool floating = i.t.size() > 1;
+
+				// x (u - t_)^+ if curve b is a
+				auto tail = [a, t_](size_t b, T u) {
+					return b == a and u > t_ ? u - t_ : T(0);
+				};
+				// integral of curve a or, for other curves, index into its cache for nondecreasing u
+				struct lookup {
+					T t_;
+					pwflat::walk<T, F> w;
+					std::optional<typename cache<T, F>::cursor> c;
+					F integral(T u)
+					{
+						return c ? c->integral(u) : w(std::min(u, t_));
+					}
+					F discount(T u)
+					{
+						return c ? c->discount(u) : exp(-w(std::min(u, t_)));
+					}
+				};
+				auto reader = [&](size_t b) {
+					lookup r{ t_, pwflat::walk<T, F>(fa.size(), fa.time(), fa.forward(), fa.extrapolate(), fa.prefix()), std::nullopt };
+					if (b != a) {
+						r.c.emplace(caches[b]);
+					}
+					return r;
+				};
+
+				// Split into constant pv and terms depending on the new forward x.
+				// Terms depending on x are a suffix starting at l0 and j0.
+				F pv = -i.price;
+				size_t l0 = i.u.size();
+				{
+					auto Dd = reader(i.d);
+					for (size_t l = 0; l < i.u.size(); ++l) {
+						if (tail(i.d, i.u[l])) {
+							l0 = l;
+							break;
+						}
+						pv += i.c[l] * Dd.discount(i.u[l]);
+					}
+				}
+				size_t j0 = floating ? i.t.size() : 0;
+				if (floating) {
+					auto Dd = reader(i.d);
+					auto Dp = reader(i.p);
+					F Ps = Dp.discount(i.t[0]);
+					for (size_t j = 1; j < i.t.size(); ++j) {
+						T e = i.t[j];
+						if (tail(i.d, e) or tail(i.p, e)) {
+							j0 = j;
+							break;
+						}
+						F Pe = Dp.discount(e);
+						pv += i.w * (Ps / Pe - 1) * Dd.discount(e);
+						Ps = Pe;
+					}
+				}
+
+				// Newton on the tail using the last forward as initial guess
+				F x = fa.size() ? fa.back().second : F(0.01);
+				F x_ = pwflat::NaN<F>;
+				for (int iter = 0; iter < 100; ++iter) {
+					F g = pv, dg = 0;
+					for (size_t l = l0; l < i.u.size(); ++l) {
+						T h = tail(i.d, i.u[l]);
+						F D = i.c[l] * exp(-I_ - x * h);
+						g += D;
+						dg -= h * D;
+					}
+					if (j0 < i.t.size()) {
+						auto Id = reader(i.d);
+						auto Ip = reader(i.p);
+						F Is = Ip.integral(i.t[j0 - 1]);
+						for (size_t j = j0; j < i.t.size(); ++j) {
+							T s = i.t[j - 1], e = i.t[j];
+							T hd = tail(i.d, e), he = tail(i.p, e), hs = tail(i.p, s);
+							F Ie = Ip.integral(e);
+							F A = Ie - Is + x * (he - hs);
+							F B = Id.integral(e) + x * hd;
+							F R = exp(A), D = exp(-B);
+							g += i.w * (R - 1) * D;
+							dg += i.w * (R * (he - hs) * D - (R - 1) * D * hd);
+							Is = Ie;
+						}
+					}
+					F dx = g / dg;
+					x -= dx;
+					if (fabs(dx) <= 1e-12) {
+						x_ = x;
+						break;
+					}
+				}
+				ensure(x_ == x_ || !"multi_curve::build: failed to converge");
+				fa.extend(u_, x_);
+			}
+			caches[a].compute(fa);
+		}
+
+		return f;
+	}
+
+	// Present value of instrument given all curves.
+	template<class U = double, class C = double, class T = double, class F = double>
+	inline F present_value(const instrument<U, C>& i, const std::vector<pwflat::curve<T, F>>& f)
+	{
+		F pv = 0;
+		for (size_t l = 0; l < i.u.size(); ++l) {
+			pv += i.c[l] * f[i.d].discount(i.u[l]);
+		}
+		for (size_t j = 1; j < i.t.size(); ++j) {
+			pv += i.w * (f[i.p].discount(i.t[j - 1]) / f[i.p].discount(i.t[j]) - 1) * f[i.d].discount(i.t[j]);
+		}
+
+		return pv;
+	}
+
+#ifdef _DEBUG
+	inline int test()
+	{
+		using inst = instrument<>;
+		// pay fixed c annually against floating every 1/q years to T
+		auto swap = [](double T, double c, size_t q, size_t d, size_t p) {
+			inst i{ {}, {}, {}, 1., d, p, 0. };
+			for (int k = 1; k <= T; ++k) {
+				i.u.push_back(k);
+				i.c.push_back(-c);
+			}
+			for (size_t k = 0; k <= T * q; ++k) {
+				i.t.push_back(double(k) / q);
+			}
+			return i;
+		};
+		{
+			// one curve from fixed cash flows is the single curve bootstrap
+			std::vector<inst> is;
+			std::vector<fixed_income::instrument_value<>> js;
+			for (int T = 1; T <= 10; ++T) {
+				auto j = bootstrap::par_swap(T, 0.03);
+				js.push_back(j);
+				is.push_back(inst{ std::vector<double>(j.time(), j.time() + j.size()),
+					std::vector<double>(j.cash(), j.cash() + j.size()), {}, 0., 0, 0, 0. });
+			}
+			auto f = build(1, std::span<const inst>(is));
+			pwflat::curve<> g;
+			for (const auto& j : js) {
+				bootstrap::extend(j, g);
+			}
+			ensure(f[0].size() == g.size());
+			for (size_t k = 0; k < g.size(); ++k) {
+				ensure(fabs(f[0].forward()[k] - g.forward()[k]) < 1e-13);
+			}
+		}
+		{
+			// curve 1 is OIS discounting, curve 0 projects 3 month rates, listed first
+			std::vector<inst> is;
+			for (int T = 1; T <= 10; ++T) {
+				is.push_back(swap(T, 0.04 + 0.0005 * T, 4, 1, 0));
+			}
+			for (int T = 1; T <= 10; ++T) {
+				is.push_back(swap(T, 0.03 + 0.0005 * T, 1, 1, 1));
+			}
+			auto f = build(2, std::span<const inst>(is));
+			ensure(f[0].size() == 10 and f[1].size() == 10);
+			for (const auto& i : is) {
+				ensure(fabs(present_value(i, f)) < 1e-12);
+			}
+			ensure(f[0].forward()[5] > f[1].forward()[5]);
+		}
+		{
+			// circular dependency
+			std::vector<inst> is;
+			is.push_back(swap(1, 0.03, 4, 1, 0));
+			is.push_back(swap(2, 0.03, 4, 0, 1));
+			bool thrown = false;
+			try {
+				build(2, std::span<const inst>(is));
+			}
+			catch (const std::exception&) {
+				thrown = true;
+			}
+			ensure(thrown);
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fms::multi_curve
@@ -15,9 +15,11 @@
 #include <algorithm>
 #include <limits>
 #include <numeric>
+#include <span>
 #include <iterator>
 #include <vector>
 #include "ensure.h"
+#include "fms_small_vector.h"
 
 namespace fms {
 	namespace pwflat {
@@ -39,6 +41,39 @@ namespace fms {
 			return monotonic(t, t + n);
 		}
 
+		// First i with t[i] >= u, or n. Branchless: the loop trip count only depends on n.
+		template<class T>
+		inline size_t lower_bound(T u, size_t n, const T* t)
+		{
+			if (n == 0) {
+				return 0;
+			}
+			const T* b = t;
+			while (n > 1) {
+				size_t h = n / 2;
+				b += (b[h - 1] < u) * h;
+				n -= h;
+			}
+
+			return (b - t) + (*b < u);
+		}
+		// First i with t[i] > u, or n.
+		template<class T>
+		inline size_t upper_bound(T u, size_t n, const T* t)
+		{
+			if (n == 0) {
+				return 0;
+			}
+			const T* b = t;
+			while (n > 1) {
+				size_t h = n / 2;
+				b += (b[h - 1] <= u) * h;
+				n -= h;
+			}
+
+			return (b - t) + (*b <= u);
+		}
+
 		// f(u) assuming t[i] monotonically increasing
 		template<class T = double, class F = double>
 		inline F value(T u, size_t n, const T* t, const F* f, F _f = NaN<F>)
@@ -48,14 +83,28 @@ namespace fms {
 			if (n == 0)
 				return _f;
 
-			auto ti = std::lower_bound(t, t + n, u);
+			size_t i = lower_bound(u, n, t);
 
-			return ti == t + n ? _f : f[ti - t];
+			return i == n ? _f : f[i];
+		}
+
+		// I[i] = int_0^t[i] f(t) dt accumulated in the same order as integral
+		template<class T, class F>
+		inline void prefix(size_t n, const T* t, const F* f, F* I)
+		{
+			F I_ = 0;
+			T t_ = 0;
+			for (size_t i = 0; i < n; ++i) {
+				I_ += f[i] * (t[i] - t_);
+				I[i] = I_;
+				t_ = t[i];
+			}
 		}
 
 		// int_0^u f(t) dt
+		// If I is not null it must be the prefix integrals of t and f.
 		template<class T, class F>
-		inline F integral(T u, size_t n, const T* t, const F* f, F _f = NaN<F>)
+		inline F integral(T u, size_t n, const T* t, const F* f, F _f = NaN<F>, const F* I = nullptr)
 		{
 			if (u < 0)
 				return NaN<F>;
@@ -64,55 +113,251 @@ namespace fms {
 			if (n == 0)
 				return u * _f;
 
-			F I = 0;
+			F I_ = 0;
 			T t_ = 0;
 
 			size_t i;
-			for (i = 0; i < n && t[i] <= u; ++i) {
-				I += f[i] * (t[i] - t_);
-				t_ = t[i];
+			if (I) {
+				// first t[i] > u
+				i = upper_bound(u, n, t);
+				if (i > 0) {
+					I_ = I[i - 1];
+					t_ = t[i - 1];
+				}
+			}
+			else {
+				for (i = 0; i < n && t[i] <= u; ++i) {
+					I_ += f[i] * (t[i] - t_);
+					t_ = t[i];
+				}
 			}
 			if (fabs(u - t_) > std::numeric_limits<T>::epsilon()) {
-				I += (i == n ? _f : f[i]) * (u - t_);
+				I_ += (i == n ? _f : f[i]) * (u - t_);
 			}
 
-			return I;
+			return I_;
 		}
 
 		// discount D(u) = exp(-int_0^u f(t) dt)
 		template<class T, class F>
-		inline F discount(T u, size_t n, const T* t, const F* f, F _f = NaN<F>)
+		inline F discount(T u, size_t n, const T* t, const F* f, F _f = NaN<F>, const F* I = nullptr)
 		{
-			return exp(-integral(u, n, t, f, _f));
+			return exp(-integral(u, n, t, f, _f, I));
 		}
 
 		// spot r(u) = (int_0^u f(t) dt)/u
 		// r(u) = f(u) if u <= t[0]
 		template<class T, class F>
-		inline F spot(T u, size_t n, const T* t, const F* f, F _f = NaN<F>)
+		inline F spot(T u, size_t n, const T* t, const F* f, F _f = NaN<F>, const F* I = nullptr)
 		{
 			return n == 0 ? _f
-				: u <= t[0] ? value(u, n, t, f, _f) : integral(u, n, t, f, _f) / u;
+				: u <= t[0] ? value(u, n, t, f, _f) : integral(u, n, t, f, _f, I) / u;
 		}
 
-		template<class T = double, class F = double>
+#ifdef _DEBUG
+		inline int test_bound()
+		{
+			double t[] = { 1, 2, 2.5, 3, 5, 8, 13 };
+			for (size_t n = 0; n <= 7; ++n) {
+				for (double u : {0., 1., 1.5, 2., 2.5, 2.75, 3., 4., 5., 8., 13., 20.}) {
+					ensure(lower_bound(u, n, t) == size_t(std::lower_bound(t, t + n, u) - t));
+					ensure(upper_bound(u, n, t) == size_t(std::upper_bound(t, t + n, u) - t));
+				}
+			}
+
+			return 0;
+		}
+
+		inline int test_prefix()
+		{
+			double t[] = { 1, 2, 3.5 }, f[] = { .01, .02, .03 }, I[3];
+			prefix(3, t, f, I);
+			for (double u : {0., .5, 1., 1.5, 2., 3., 3.5, 4., 10.}) {
+				ensure(integral(u, 3, t, f, .04, I) == integral(u, 3, t, f, .04));
+				ensure(discount(u, 3, t, f, .04, I) == discount(u, 3, t, f, .04));
+				ensure(spot(u, 3, t, f, .04, I) == spot(u, 3, t, f, .04));
+			}
+			ensure(integral(1e-20, 3, t, f, .04, I) == integral(1e-20, 3, t, f, .04));
+
+			return 0;
+		}
+#endif // _DEBUG
+
+		// int_0^u f(t) dt for nondecreasing u in O(n + m) over m calls.
+		// Accumulates in the same order as integral so results are identical.
+		template<class T, class F>
+		class walk {
+			size_t n;
+			const T* t;
+			const F* f;
+			F _f;
+			const F* I;
+			size_t i; // first t[i] > u
+			T t_;     // t[i - 1]
+			F I_;     // int_0^t_ f(t) dt
+		public:
+			walk(size_t n, const T* t, const F* f, F _f = NaN<F>, const F* I = nullptr)
+				: n(n), t(t), f(f), _f(_f), I(I), i(0), t_(0), I_(0)
+			{ }
+
+			F operator()(T u)
+			{
+				if (u < 0)
+					return NaN<F>;
+				if (u == 0)
+					return 0;
+				if (n == 0)
+					return u * _f;
+
+				for (; i < n && t[i] <= u; ++i) {
+					I_ = I ? I[i] : I_ + f[i] * (t[i] - t_);
+					t_ = t[i];
+				}
+
+				return fabs(u - t_) > std::numeric_limits<T>::epsilon() ? I_ + (i == n ? _f : f[i]) * (u - t_) : I_;
+			}
+		};
+
+		// v[j] = value(u[j], n, t, f, _f). v may alias u.
+		template<class T, class F>
+		inline void value(std::span<const T> u, size_t n, const T* t, const F* f, F _f, std::span<F> v)
+		{
+			ensure(u.size() == v.size());
+
+			if (n > 0 and std::is_sorted(u.begin(), u.end())) {
+				size_t i = 0;
+				for (size_t j = 0; j < u.size(); ++j) {
+					T uj = u[j];
+					while (i < n && t[i] < uj) {
+						++i;
+					}
+					v[j] = uj < 0 ? NaN<F> : i == n ? _f : f[i];
+				}
+			}
+			else {
+				for (size_t j = 0; j < u.size(); ++j) {
+					v[j] = value(u[j], n, t, f, _f);
+				}
+			}
+		}
+
+		// v[j] = integral(u[j], n, t, f, _f, I). v may alias u.
+		template<class T, class F>
+		inline void integral(std::span<const T> u, size_t n, const T* t, const F* f, F _f, const F* I, std::span<F> v)
+		{
+			ensure(u.size() == v.size());
+
+			if (std::is_sorted(u.begin(), u.end())) {
+				walk<T, F> w(n, t, f, _f, I);
+				for (size_t j = 0; j < u.size(); ++j) {
+					v[j] = w(u[j]);
+				}
+			}
+			else {
+				for (size_t j = 0; j < u.size(); ++j) {
+					v[j] = integral(u[j], n, t, f, _f, I);
+				}
+			}
+		}
+
+		// v[j] = discount(u[j], n, t, f, _f, I). v may alias u.
+		template<class T, class F>
+		inline void discount(std::span<const T> u, size_t n, const T* t, const F* f, F _f, const F* I, std::span<F> v)
+		{
+			integral(u, n, t, f, _f, I, v);
+			// exp is a scalar library call unless a vector math library is enabled (e.g. -ffast-math with libmvec)
+			for (size_t j = 0; j < v.size(); ++j) {
+				v[j] = exp(-v[j]);
+			}
+		}
+
+		// v[j] = spot(u[j], n, t, f, _f, I). v may alias u.
+		template<class T, class F>
+		inline void spot(std::span<const T> u, size_t n, const T* t, const F* f, F _f, const F* I, std::span<F> v)
+		{
+			ensure(u.size() == v.size());
+
+			if (n == 0) {
+				std::fill(v.begin(), v.end(), _f);
+			}
+			else if (std::is_sorted(u.begin(), u.end())) {
+				walk<T, F> w(n, t, f, _f, I);
+				for (size_t j = 0; j < u.size(); ++j) {
+					T uj = u[j];
+					F Ij = w(uj);
+					v[j] = uj < 0 ? NaN<F> : uj <= t[0] ? f[0] : Ij / uj;
+				}
+			}
+			else {
+				for (size_t j = 0; j < u.size(); ++j) {
+					v[j] = spot(u[j], n, t, f, _f, I);
+				}
+			}
+		}
+
+#ifdef _DEBUG
+		inline int test_batch()
+		{
+			double t[] = { 1, 2, 3.5 }, f[] = { .01, .02, .03 }, I[3];
+			prefix(3, t, f, I);
+			double u[] = { -1., 0., 1e-20, .5, 1., 1.5, 2., 3., 3.5, 4., 10. };
+			double w[] = { 3., -1., 10., .5, 0., 3.5, 1., 2., 1.5, 4., 1e-20 };
+			constexpr size_t m = sizeof(u) / sizeof(*u);
+			double v[m];
+			auto same = [](double x, double y) { return x == y or (x != x and y != y); };
+			for (auto x : {std::span<const double>(u), std::span<const double>(w)}) {
+				for (const double* I_ : {(const double*)nullptr, (const double*)I}) {
+					value(x, 3, t, f, .04, std::span<double>(v));
+					for (size_t j = 0; j < m; ++j) {
+						ensure(same(v[j], value(x[j], 3, t, f, .04)));
+					}
+					integral(x, 3, t, f, .04, I_, std::span<double>(v));
+					for (size_t j = 0; j < m; ++j) {
+						ensure(same(v[j], integral(x[j], 3, t, f, .04)));
+					}
+					discount(x, 3, t, f, .04, I_, std::span<double>(v));
+					for (size_t j = 0; j < m; ++j) {
+						ensure(same(v[j], discount(x[j], 3, t, f, .04)));
+					}
+					spot(x, 3, t, f, .04, I_, std::span<double>(v));
+					for (size_t j = 0; j < m; ++j) {
+						ensure(same(v[j], spot(x[j], 3, t, f, .04)));
+					}
+				}
+			}
+			{
+				// in place
+				double x[] = { .5, 1.5, 2.5 };
+				discount(std::span<const double>(x), 3, t, f, .04, (const double*)I, std::span<double>(x));
+				ensure(x[0] == discount(.5, 3, t, f, .04) and x[2] == discount(2.5, 3, t, f, .04));
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+
+		// Knots are stored in std::vector if N == 0, otherwise up to N knots are stored in place.
+		template<class T = double, class F = double, size_t N = 0>
 		class curve {
-			std::vector<T> t;
-			std::vector<F> f;
+			storage<T, N> t;
+			storage<F, N> f;
+			storage<F, N> I; // I[i] = int_0^t[i] f(t) dt
 			F _f;
 		public:
 			curve()
 				: _f(NaN<F>)
 			{ }
 			curve(size_t n, const T* t_, const F* f_, F _f = NaN<F>)
-				: t(t_, t_ + n), f(f_, f_ + n), _f(_f)
+				: t(t_, t_ + n), f(f_, f_ + n), I(n), _f(_f)
 			{
 				ensure(ok());
+				pwflat::prefix(n, t_, f_, I.data());
 			}
 			curve(const std::vector<T>& t, const std::vector<F>& f, F _f = NaN<F>)
-				: t(t), f(f), _f(_f)
+				: t(t), f(f), I(t.size()), _f(_f)
 			{
 				ensure(ok());
+				pwflat::prefix(t.size(), t.data(), f.data(), I.data());
 			}
 			curve(const curve&) = default;
 			curve& operator=(const curve&) = default;
@@ -142,6 +387,11 @@ namespace fms {
 			{
 				return f.data();
 			}
+			// integral to each knot
+			const F* prefix() const
+			{
+				return I.data();
+			}
 			std::pair<T, F> back() const
 			{
 				return { t.back(), f.back() };
@@ -152,11 +402,23 @@ namespace fms {
 			{
 				ensure(size() == 0 || t_ > t.back());
 
+				I.push_back((size() == 0 ? 0 : I.back()) + f_ * (t_ - (size() == 0 ? 0 : t.back())));
 				t.push_back(t_);
 				f.push_back(f_);
 
 				return *this;
 			}
+			// keep the first n points
+			curve& truncate(size_t n)
+			{
+				if (n < size()) {
+					t.resize(n);
+					f.resize(n);
+					I.resize(n);
+				}
+
+				return *this;
+			}
 			// Get extrapolated value.
 			F extrapolate() const
 			{
@@ -166,6 +428,8 @@ namespace fms {
 			curve& extrapolate(F f_)
 			{
 				_f = f_;
+
+				return *this;
 			}
 
 			F value(T u) const
@@ -178,17 +442,57 @@ namespace fms {
 			}
 			F integral(T u) const
 			{
-				return pwflat::integral(u, t.size(), t.data(), f.data(), _f);
+				return pwflat::integral(u, t.size(), t.data(), f.data(), _f, I.data());
 			}
 			F discount(T u) const
 			{
-				return pwflat::discount(u, t.size(), t.data(), f.data(), _f);
+				return pwflat::discount(u, t.size(), t.data(), f.data(), _f, I.data());
 			}
 			F spot(T u) const
 			{
-				return pwflat::spot(u, t.size(), t.data(), f.data(), _f);
+				return pwflat::spot(u, t.size(), t.data(), f.data(), _f, I.data());
+			}
+
+			// batch versions, v may alias u
+			void value(std::span<const T> u, std::span<F> v) const
+			{
+				pwflat::value(u, t.size(), t.data(), f.data(), _f, v);
+			}
+			void integral(std::span<const T> u, std::span<F> v) const
+			{
+				pwflat::integral(u, t.size(), t.data(), f.data(), _f, I.data(), v);
+			}
+			void discount(std::span<const T> u, std::span<F> v) const
+			{
+				pwflat::discount(u, t.size(), t.data(), f.data(), _f, I.data(), v);
+			}
+			void spot(std::span<const T> u, std::span<F> v) const
+			{
+				pwflat::spot(u, t.size(), t.data(), f.data(), _f, I.data(), v);
 			}
 		};
 
+#ifdef _DEBUG
+		inline int test_storage()
+		{
+			double t[] = { 1, 2, 3, 5, 7, 10 }, f[] = { .01, .02, .03, .035, .04, .042 };
+			curve<> c(6, t, f, .05);
+			curve<double, double, 4> d(4, t, f, .05);
+			d.extrapolate(.05);
+			d.extend(t[4], f[4]).extend(t[5], f[5]); // spill to heap
+			curve<double, double, 4> e(d), g(std::move(d));
+			for (double u : {0., .5, 1., 2.5, 7., 12.}) {
+				ensure(e.value(u) == c.value(u));
+				ensure(e.integral(u) == c.integral(u));
+				ensure(g.spot(u) == c.spot(u));
+			}
+			e.truncate(3);
+			curve<double, double, 4> h(std::move(e));
+			ensure(h.size() == 3 and h.back().first == 3);
+
+			return 0;
+		}
+#endif // _DEBUG
+
 	} // namespace pwflat
 } // namespace fms
\ No newline at end of file
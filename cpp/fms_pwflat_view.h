@@ -0,0 +1,241 @@
+// fms_pwflat_view.h - Shifted views of a piecewise flat curve
+// A view of curve f with shift s has forward f(t) + s(t) and integral I(u) + S(u)
+// where S(u) = int_0^u s(t) dt is analytic. Views do not own or copy the curve.
+#pragma once
+#include "ensure.h"
+#include "fms_pwflat.h"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <span>
+
+namespace fms::pwflat {
+
+	// s(t) = h
+	template<class T = double, class F = double>
+	struct parallel {
+		F h;
+
+		F value(T u) const
+		{
+			return u < 0 ? NaN<F> : h;
+		}
+		F integral(T u) const
+		{
+			return u < 0 ? NaN<F> : h * u;
+		}
+	};
+
+	// Key rate shift rising linearly from 0 at a to h at b and falling to 0 at c.
+	// If a == b it is h before b and if c == b it is h after b.
+	template<class T = double, class F = double>
+	struct triangle {
+		T a, b, c;
+		F h;
+
+		triangle(T a, T b, T c, F h)
+			: a(a), b(b), c(c), h(h)
+		{
+			ensure(0 <= a and a <= b and b <= c);
+		}
+
+		F value(T u) const
+		{
+			if (u < 0)
+				return NaN<F>;
+			if (u <= b)
+				return a < b ? h * std::max<T>(u - a, 0) / (b - a) : h;
+
+			return b < c ? h * std::max<T>(c - u, 0) / (c - b) : h;
+		}
+		F integral(T u) const
+		{
+			if (u < 0)
+				return NaN<F>;
+
+			T x = std::min(u, b);
+			F S = a < b ? h * (std::max(x, a) - a) * (std::max(x, a) - a) / (2 * (b - a)) : h * x;
+			if (u > b) {
+				if (b < c) {
+					T y = std::min(u, c);
+					S += h * ((c - b) * (c - b) - (c - y) * (c - y)) / (2 * (c - b));
+				}
+				else {
+					S += h * (u - b);
+				}
+			}
+
+			return S;
+		}
+	};
+
+	// s(t) = df[i] for t[i-1] < t <= t[i] on the knots of a curve and _df after the last knot.
+	// If I is not null it must be the prefix integrals of the knots and df.
+	template<class T = double, class F = double>
+	struct segment {
+		size_t n;
+		const T* t;
+		const F* df;
+		F _df;
+		const F* I;
+
+		template<size_t N>
+		segment(const curve<T, F, N>& f, std::span<const F> df, F _df = 0, const F* I = nullptr)
+			: n(f.size()), t(f.time()), df(df.data()), _df(_df), I(I)
+		{
+			ensure(df.size() == n);
+		}
+
+		F value(T u) const
+		{
+			return pwflat::value(u, n, t, df, _df);
+		}
+		F integral(T u) const
+		{
+			return pwflat::integral(u, n, t, df, _df, I);
+		}
+	};
+
+	// Non-owning curve f shifted by s. The curve must outlive the view.
+	template<class S, class T = double, class F = double, size_t N = 0>
+	class view {
+		const curve<T, F, N>* f;
+		S s;
+	public:
+		view(const curve<T, F, N>& f, const S& s)
+			: f(&f), s(s)
+		{ }
+
+		const S& shift() const
+		{
+			return s;
+		}
+
+		F value(T u) const
+		{
+			return f->value(u) + s.value(u);
+		}
+		F operator()(T u) const
+		{
+			return value(u);
+		}
+		F integral(T u) const
+		{
+			return f->integral(u) + s.integral(u);
+		}
+		F discount(T u) const
+		{
+			return exp(-integral(u));
+		}
+		F spot(T u) const
+		{
+			return u > 0 ? f->spot(u) + s.integral(u) / u : f->spot(u) + s.value(u);
+		}
+
+		// v[j] = discount(u[j]), v may alias u
+		void discount(std::span<const T> u, std::span<F> v) const
+		{
+			ensure(u.size() == v.size());
+
+			// read u[j] before v[j] is written
+			if (std::is_sorted(u.begin(), u.end())) {
+				walk<T, F> w(f->size(), f->time(), f->forward(), f->extrapolate(), f->prefix());
+				for (size_t j = 0; j < v.size(); ++j) {
+					T uj = u[j];
+					v[j] = exp(-(w(uj) + s.integral(uj)));
+				}
+			}
+			else {
+				for (size_t j = 0; j < v.size(); ++j) {
+					T uj = u[j];
+					v[j] = exp(-(f->integral(uj) + s.integral(uj)));
+				}
+			}
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test_view()
+	{
+		double t[] = { 1, 2, 5, 10 }, f[] = { 0.03, 0.032, 0.035, 0.04 };
+		curve<> c(4, t, f, 0.042);
+		double h = 0.0001;
+		{
+			// parallel shift is the shifted curve
+			double g[4];
+			for (size_t i = 0; i < 4; ++i) {
+				g[i] = f[i] + h;
+			}
+			curve<> d(4, t, g, 0.042 + h);
+			view v(c, parallel<>{ h });
+			for (double u : {0., 0.5, 1., 3., 10., 20.}) {
+				ensure(fabs(v.value(u) - d.value(u)) < 1e-15);
+				ensure(fabs(v.integral(u) - d.integral(u)) < 1e-14);
+				ensure(fabs(v.discount(u) - d.discount(u)) < 1e-14);
+				ensure(fabs(v.spot(u) - d.spot(u)) < 1e-15);
+			}
+		}
+		{
+			// segment shift with and without prefix
+			double df[] = { 0, h, 2 * h, 0 }, I[4];
+			prefix(4, t, df, I);
+			double g[4];
+			for (size_t i = 0; i < 4; ++i) {
+				g[i] = f[i] + df[i];
+			}
+			curve<> d(4, t, g, 0.042 + h);
+			view v(c, segment<>(c, std::span<const double>(df), h));
+			view w(c, segment<>(c, std::span<const double>(df), h, I));
+			for (double u : {0.5, 1., 1.5, 3., 10., 20.}) {
+				ensure(v.value(u) == d.value(u));
+				ensure(fabs(v.integral(u) - d.integral(u)) < 1e-14);
+				ensure(fabs(w.integral(u) - d.integral(u)) < 1e-14);
+			}
+		}
+		{
+			// key rate triangles at the knots sum to a parallel shift
+			triangle<> k[] = { { 1, 1, 2, h }, { 1, 2, 5, h }, { 2, 5, 10, h }, { 5, 10, 10, h } };
+			for (double u : {0., 0.5, 1., 1.5, 2., 4., 5., 7., 10., 20.}) {
+				double s = 0, S = 0;
+				for (const auto& k_ : k) {
+					s += k_.value(u);
+					S += k_.integral(u);
+				}
+				ensure(fabs(s - h) < 1e-18);
+				ensure(fabs(S - h * u) < 1e-17);
+			}
+			// integral of value by midpoint rule, exact for linear pieces between kinks
+			for (const auto& k_ : k) {
+				double S = 0, du = 0.001;
+				for (double u = du / 2; u < 12; u += du) {
+					S += k_.value(u) * du;
+				}
+				ensure(fabs(S - k_.integral(12)) < 1e-12);
+			}
+			view v(c, k[2]);
+			double u[] = { 1, 3, 6, 12 }, D[4];
+			v.discount(std::span<const double>(u), std::span<double>(D));
+			for (size_t j = 0; j < 4; ++j) {
+				ensure(fabs(D[j] - exp(-c.integral(u[j]) - k[2].integral(u[j]))) < 1e-16);
+			}
+			{
+				// in place, sorted and unsorted
+				double x[] = { 1, 3, 6, 12 }, y[] = { 12, 1, 6, 3 };
+				for (double* z : {x, y}) {
+					double D_[4];
+					for (size_t j = 0; j < 4; ++j) {
+						D_[j] = v.discount(z[j]);
+					}
+					v.discount(std::span<const double>(z, 4), std::span<double>(z, 4));
+					for (size_t j = 0; j < 4; ++j) {
+						ensure(z[j] == D_[j]);
+					}
+				}
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fms::pwflat
@@ -0,0 +1,239 @@
+// fms_small_vector.h - Vector of trivially copyable values with N stored in place
+// Sizes up to N use the inline buffer and copies and moves are memcpy.
+// Larger sizes spill to the heap.
+#pragma once
+#include "ensure.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace fms {
+
+	template<class X, size_t N>
+	class small_vector {
+		static_assert(std::is_trivially_copyable_v<X>);
+		static_assert(N > 0);
+
+		X* h;       // heap storage or nullptr if inline
+		size_t n;   // size
+		size_t c;   // capacity
+		X b[N];     // inline storage
+
+		// copy m elements from p into storage with capacity at least m
+		void copy(const X* p, size_t m)
+		{
+			reserve(m);
+			if (m) {
+				std::memcpy(data(), p, m * sizeof(X));
+			}
+			n = m;
+		}
+	public:
+		small_vector()
+			: h(nullptr), n(0), c(N)
+		{ }
+		// n value initialized elements
+		explicit small_vector(size_t m)
+			: small_vector()
+		{
+			resize(m);
+		}
+		template<std::input_iterator I>
+		small_vector(I i, I e)
+			: small_vector()
+		{
+			for (; i != e; ++i) {
+				push_back(*i);
+			}
+		}
+		small_vector(const X* i, const X* e)
+			: small_vector()
+		{
+			copy(i, e - i);
+		}
+		small_vector(const std::vector<X>& v)
+			: small_vector()
+		{
+			copy(v.data(), v.size());
+		}
+		small_vector(const small_vector& v)
+			: small_vector()
+		{
+			copy(v.data(), v.size());
+		}
+		small_vector& operator=(const small_vector& v)
+		{
+			if (this != &v) {
+				n = 0;
+				copy(v.data(), v.size());
+			}
+
+			return *this;
+		}
+		small_vector(small_vector&& v) noexcept
+			: h(v.h), n(v.n), c(v.c)
+		{
+			if (!h and n) {
+				std::memcpy(b, v.b, n * sizeof(X));
+			}
+			v.h = nullptr;
+			v.n = 0;
+			v.c = N;
+		}
+		small_vector& operator=(small_vector&& v) noexcept
+		{
+			if (this != &v) {
+				delete[] h;
+				h = v.h;
+				n = v.n;
+				c = v.c;
+				if (!h and n) {
+					std::memcpy(b, v.b, n * sizeof(X));
+				}
+				v.h = nullptr;
+				v.n = 0;
+				v.c = N;
+			}
+
+			return *this;
+		}
+		~small_vector()
+		{
+			delete[] h;
+		}
+
+		size_t size() const
+		{
+			return n;
+		}
+		bool empty() const
+		{
+			return n == 0;
+		}
+		size_t capacity() const
+		{
+			return c;
+		}
+		// true if elements are stored in place
+		bool is_inline() const
+		{
+			return h == nullptr;
+		}
+		X* data()
+		{
+			return h ? h : b;
+		}
+		const X* data() const
+		{
+			return h ? h : b;
+		}
+		X* begin()
+		{
+			return data();
+		}
+		X* end()
+		{
+			return data() + n;
+		}
+		const X* begin() const
+		{
+			return data();
+		}
+		const X* end() const
+		{
+			return data() + n;
+		}
+		X& operator[](size_t i)
+		{
+			return data()[i];
+		}
+		const X& operator[](size_t i) const
+		{
+			return data()[i];
+		}
+		X& back()
+		{
+			return data()[n - 1];
+		}
+		const X& back() const
+		{
+			return data()[n - 1];
+		}
+
+		void reserve(size_t m)
+		{
+			if (m > c) {
+				size_t c_ = std::max(m, 2 * c);
+				X* h_ = new X[c_];
+				if (n) {
+					std::memcpy(h_, data(), n * sizeof(X));
+				}
+				delete[] h;
+				h = h_;
+				c = c_;
+			}
+		}
+		void push_back(const X& x)
+		{
+			if (n == c) {
+				X x_ = x; // x may be an element
+				reserve(n + 1);
+				data()[n++] = x_;
+			}
+			else {
+				data()[n++] = x;
+			}
+		}
+		// new elements are value initialized
+		void resize(size_t m)
+		{
+			reserve(m);
+			if (m > n) {
+				std::fill(data() + n, data() + m, X{});
+			}
+			n = m;
+		}
+		void clear()
+		{
+			n = 0;
+		}
+
+#ifdef _DEBUG
+		static int test()
+		{
+			small_vector v;
+			ensure(v.empty() and v.is_inline());
+			for (size_t i = 0; i < N; ++i) {
+				v.push_back(X(i));
+			}
+			ensure(v.size() == N and v.is_inline());
+			small_vector w(v);
+			ensure(w.size() == N and w.is_inline() and w.back() == X(N - 1));
+			v.push_back(v[0]);
+			ensure(v.size() == N + 1 and !v.is_inline() and v.back() == X(0));
+			w = v;
+			ensure(w.size() == N + 1 and w[N - 1] == X(N - 1));
+			small_vector x(std::move(v));
+			ensure(v.empty() and x.size() == N + 1 and x.back() == X(0));
+			x.resize(2);
+			small_vector y(std::move(x));
+			ensure(y.size() == 2 and y[1] == X(1));
+			y.resize(4);
+			ensure(y[3] == X(0));
+			std::vector<X> z{ X(1), X(2) };
+			small_vector s(z);
+			ensure(s.size() == 2 and s[1] == X(2));
+
+			return 0;
+		}
+#endif // _DEBUG
+	};
+
+	// std::vector if N == 0, otherwise N values in place
+	template<class X, size_t N>
+	using storage = std::conditional_t<N == 0, std::vector<X>, small_vector<X, N>>;
+
+} // namespace fms
@@ -0,0 +1,143 @@
+// fms_swap.h - Par swap rates and annuities for all tenors in one pass
+// A fixed leg paying at t[1] < ... < t[n] from effective date t[0] has annuity
+// A[k] = sum_{0 < j <= k} (t[j] - t[j-1]) D(t[j]) and a single curve floating leg
+// worth D(t[0]) - D(t[k]). The par rate to t[k] is (D(t[0]) - D(t[k]))/A[k] and
+// the forward starting par rate from t[j] to t[k] is (D(t[j]) - D(t[k]))/(A[k] - A[j]).
+#pragma once
+#include "ensure.h"
+#include "fms_pwflat.h"
+#include <cmath>
+#include <algorithm>
+#include <span>
+#include <vector>
+#ifdef _DEBUG
+#include "fms_bootstrap.h"
+#endif
+
+namespace fms::swap {
+
+	template<class T = double, class F = double>
+	class sweep {
+		std::vector<T> t;
+		std::vector<F> D, A;
+	public:
+		// Discounts and annuities at increasing payment dates t[0], ..., t[n] walking the curve once.
+		template<size_t N>
+		sweep(std::span<const T> t_, const pwflat::curve<T, F, N>& f)
+			: t(t_.begin(), t_.end()), D(t.size()), A(t.size())
+		{
+			ensure(t.size() > 1);
+			ensure(pwflat::monotonic(t.size(), t.data()));
+
+			f.discount(std::span<const T>(t), std::span<F>(D));
+			A[0] = 0;
+			for (size_t k = 1; k < t.size(); ++k) {
+				A[k] = A[k - 1] + (t[k] - t[k - 1]) * D[k];
+			}
+		}
+		// n payments with frequency q per year starting at t0
+		template<size_t N>
+		sweep(T t0, size_t q, size_t n, const pwflat::curve<T, F, N>& f)
+			: sweep(dates(t0, q, n), f)
+		{ }
+
+		// payment dates t[0], ..., t[k] for k = 1, ..., n
+		static std::vector<T> dates(T t0, size_t q, size_t n)
+		{
+			std::vector<T> t(n + 1);
+			for (size_t k = 0; k <= n; ++k) {
+				t[k] = t0 + T(k) / q;
+			}
+
+			return t;
+		}
+
+		// number of payments
+		size_t size() const
+		{
+			return t.size() - 1;
+		}
+		T time(size_t k) const
+		{
+			return t[k];
+		}
+		F discount(size_t k) const
+		{
+			return D[k];
+		}
+		F annuity(size_t k) const
+		{
+			return A[k];
+		}
+		// forward starting annuity from t[j] to t[k]
+		F annuity(size_t j, size_t k) const
+		{
+			return A[k] - A[j];
+		}
+		// par rate of swap from t[0] to t[k]
+		F par(size_t k) const
+		{
+			return (D[0] - D[k]) / A[k];
+		}
+		// forward starting par rate from t[j] to t[k]
+		F par(size_t j, size_t k) const
+		{
+			ensure(j < k);
+
+			return (D[j] - D[k]) / (A[k] - A[j]);
+		}
+
+		// Par rates of every q-th payment date, e.g. annual tenors of a quarterly leg.
+		void par(size_t q, std::span<F> s) const
+		{
+			ensure(s.size() * q <= size());
+
+			for (size_t k = 0; k < s.size(); ++k) {
+				s[k] = par((k + 1) * q);
+			}
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test()
+	{
+		double t[] = { 1, 2, 5, 10, 30 }, f[] = { 0.03, 0.032, 0.035, 0.04, 0.042 };
+		pwflat::curve<> g(5, t, f, 0.045);
+		sweep<> s(0.25, 2, 100, g);
+		ensure(s.size() == 100);
+		ensure(s.time(100) == 50.25);
+
+		// par swaps price to 1 at effective date
+		for (size_t k : {1, 2, 20, 59, 100}) {
+			double c = s.par(k);
+			fixed_income::instrument_value<> i({ s.time(0) }, { -1 });
+			for (size_t j = 1; j <= k; ++j) {
+				i.extend(s.time(j), c / 2 + (j == k));
+			}
+			double pv = bootstrap::present_value(i.size(), i.time(), i.cash(), g.size(), g.time(), g.forward(), g.extrapolate());
+			ensure(fabs(pv) < 1e-14);
+		}
+		// forward starting
+		{
+			size_t j = 10, k = 30;
+			double c = s.par(j, k);
+			fixed_income::instrument_value<> i({ s.time(j) }, { -1 });
+			for (size_t l = j + 1; l <= k; ++l) {
+				i.extend(s.time(l), c / 2 + (l == k));
+			}
+			double pv = bootstrap::present_value(i.size(), i.time(), i.cash(), g.size(), g.time(), g.forward(), g.extrapolate());
+			ensure(fabs(pv) < 1e-14);
+			ensure(fabs(s.annuity(j, k) * c - (s.discount(j) - s.discount(k))) < 1e-15);
+		}
+		// annual tenors
+		{
+			double p[50];
+			s.par(2, std::span<double>(p));
+			ensure(p[0] == s.par(2) and p[49] == s.par(100));
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fms::swap
@@ -0,0 +1,215 @@
+// fms_trinomial.h - Trinomial lattice option pricing
+// W_k = X_1 + ... + X_k, P(X_j = 1) = P(X_j = -1) = 1/6, P(X_j = 0) = 2/3.
+// E[X_j] = 0, Var(X_j) = 1/3, E[X_j^4] = 1/3 = 3 Var(X_j)^2 matches the normal kurtosis.
+// W_k takes values j - k, 0 <= j <= 2k.
+// F_k(j) = f exp(a_n (j - k))/c_n^k, a_n = s sqrt(3/n), c_n = E[exp(a_n X_j)] = 2/3 + cosh(a_n)/3.
+// E[F_n] = f, Var(log F_n) = s^2.
+// The payoff phi and scratch buffer v are the same as fms::binomial except v.size() = 2n + 1.
+#pragma once
+#include "ensure.h"
+#include <cmath>
+#include <algorithm>
+#include <span>
+
+namespace fms::trinomial {
+
+	// P(X_j = -1), P(X_j = 0), P(X_j = 1)
+	template<class X = double>
+	constexpr X pd = X(1) / 6;
+	template<class X = double>
+	constexpr X pm = X(2) / 3;
+	template<class X = double>
+	constexpr X pu = X(1) / 6;
+
+	// a_n and c_n
+	template<class X>
+	inline std::pair<X, X> jump(X s, size_t n)
+	{
+		X an = s * sqrt(X(3) / n);
+		X cn = pm<X> + 2 * pu<X> * cosh(an);
+
+		return { an, cn };
+	}
+
+	// F_k(j)
+	template<class X>
+	inline X forward(X f, X s, size_t n, size_t k, size_t j)
+	{
+		ensure(n >= k and 2 * k >= j);
+
+		if (n == 0) {
+			return f;
+		}
+
+		auto [an, cn] = jump(s, n);
+
+		return f * exp(an * (X(j) - X(k))) / pow(cn, k);
+	}
+
+	// Populate F_n(j) at step n = (F.size() - 1)/2
+	template<class X, size_t N>
+	inline size_t fill(X f, X s, std::span<X, N> F)
+	{
+		ensure(F.size() % 2 == 1);
+		size_t n = F.size() / 2;
+
+		if (n == 0) {
+			F[0] = f;
+		}
+		else {
+			auto [an, cn] = jump(s, n);
+			X u = exp(an);
+			// F_n(j) = F_n(n) u^(j - n) symmetric about the center
+			F[n] = f / pow(cn, n);
+			for (size_t j = 1; j <= n; ++j) {
+				F[n + j] = F[n + j - 1] * u;
+				F[n - j] = F[n - j + 1] / u;
+			}
+		}
+
+		return n;
+	}
+
+#ifdef _DEBUG
+	inline int fill_test()
+	{
+		double f = 100, s = 0.1;
+		double F[11];
+		{
+			fill(f, s, std::span(F, 1));
+			ensure(F[0] == f);
+		}
+		for (size_t n : {1, 2, 5}) {
+			fill(f, s, std::span(F, 2 * n + 1));
+			for (size_t j = 0; j <= 2 * n; ++j) {
+				ensure(fabs(F[j] - forward(f, s, n, n, j)) <= 1e-13 * f);
+			}
+		}
+
+		return 0;
+	}
+#endif // _DEBUG
+
+	namespace european {
+
+		// { v[0], ..., v[m-1] } => { pd v[0] + pm v[1] + pu v[2], ..., pd v[m-3] + pm v[m-2] + pu v[m-1] }
+		// Since pd = pu this is pm v[j + 1] + pu (v[j] + v[j + 2]).
+		template<class X, size_t N>
+		constexpr auto step(std::span<X, N> v)
+		{
+			for (size_t j = 0; j < v.size() - 2; ++j) {
+				v[j] = std::fma(pm<X>, v[j + 1], pu<X> * (v[j] + v[j + 2]));
+			}
+
+			return std::span<X>(v.begin(), v.size() - 2);
+		}
+
+		// E[phi(F_n)]
+		template<class Phi, class X, size_t N>
+		inline X value(X f, X s, Phi phi, std::span<X, N> v)
+		{
+			fill(f, s, v);
+			// Apply phi to F
+			std::transform(v.begin(), v.end(), v.begin(), phi);
+			// Expected value
+			std::span<X> v_(v);
+			while (v_.size() > 1) {
+				v_ = step(v_);
+			}
+
+			return v_[0];
+		}
+
+#ifdef _DEBUG
+		inline int test()
+		{
+			double f = 100, s = 0.1, k = 100;
+			double v[201];
+			{
+				double v0 = value(f, s, [](double x) { return x; }, std::span(v, 201));
+				ensure(fabs(v0 - f) < 1e-12);
+			}
+			{
+				// Black value is 3.9878
+				double v0 = value(f, s, [=](double x) { return std::max(x - k, 0.); }, std::span(v, 201));
+				ensure(fabs(v0 - 3.9878) < 3e-3);
+				v0 = value(f, s, [=](double x) { return std::max(k - x, 0.); }, std::span(v, 201));
+				ensure(fabs(v0 - 3.9878) < 3e-3);
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+
+	} // namespace european
+
+	namespace american {
+
+		// Expected value then early exercise at level k = (v.size() - 3)/2.
+		// Forwards at a level are F_k(0) u^j so each node is a multiply-add and a multiply.
+		template<class Phi, class X = double>
+		inline auto step(X f, X s, size_t n, Phi phi, std::span<X> v)
+		{
+			size_t k = (v.size() - 3) / 2;
+			auto [an, cn] = jump(s, n);
+			X u = exp(an);
+			X F = f * exp(-an * k) / pow(cn, k); // F_k(0)
+
+			for (size_t j = 0; j < v.size() - 2; ++j) {
+				v[j] = std::fma(pm<X>, v[j + 1], pu<X> * (v[j] + v[j + 2]));
+				X vj = phi(F);
+				if (vj > v[j]) {
+					v[j] = vj;
+				}
+				F *= u;
+			}
+
+			return std::span<X>(v.begin(), v.size() - 2);
+		}
+
+		// Return max_tau E[phi(F_tau)]
+		template<class Phi, class X = double>
+		inline X value(X f, X s, Phi phi, std::span<X> v)
+		{
+			size_t n = fill(f, s, v);
+			// Apply phi to F
+			std::transform(v.begin(), v.end(), v.begin(), phi);
+			// Expected value
+			while (v.size() > 1) {
+				v = step(f, s, n, phi, v);
+			}
+
+			return v[0];
+		}
+
+#ifdef _DEBUG
+		inline int test()
+		{
+			double f = 100, s = 0.1, k = 100;
+			double v[201];
+			{
+				auto id = [](double x) { return x; };
+				ensure(value(f, s, id, std::span(v, 1)) == f);
+				ensure(fabs(value(f, s, id, std::span(v, 3)) - f) < 1e-12);
+				ensure(fabs(value(f, s, id, std::span(v, 5)) - f) < 1e-12);
+			}
+			{
+				auto c = [=](double x) { return std::max(x - k, 0.); };
+				double va = value(f, s, c, std::span(v, 201));
+				double ve = european::value(f, s, c, std::span(v, 201));
+				ensure(fabs(va - ve) < 1e-12);
+			}
+			{
+				auto p = [=](double x) { return std::max(k - x, 0.); };
+				double va = value(f, s, p, std::span(v, 201));
+				double ve = european::value(f, s, p, std::span(v, 201));
+				ensure(va >= ve - 1e-12);
+			}
+
+			return 0;
+		}
+#endif // _DEBUG
+
+	} // namespace american
+
+} // namespace fms::trinomial
@@ -0,0 +1,212 @@
+// fms_variance_swap.h - Fair variance term structure from option chains
+// The log contract -2 log(k/f) = -2 log k + 2 log f so the Carr-Madan weights of -2 log k
+// only depend on the strikes and are shared by all expiries with the same strike grid.
+// Using the forward as put/call separator the fair total variance at expiry t is
+// w(t) = g(f) + 2 log f + sum_{k[i] < f} w[i] p[i] + sum_{k[i] >= f} w[i] c[i]
+// where g is the piecewise linear interpolation of -2 log k[i].
+// Forward variance over [t_{j-1}, t_j] is (w(t_j) - w(t_{j-1}))/(t_j - t_{j-1}) and variance
+// at other times is interpolated linearly in total variance, as for the VIX.
+#pragma once
+#include "ensure.h"
+#include "fms_carr_madan.h"
+#include <cmath>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <span>
+#include <vector>
+#ifdef _DEBUG
+#include "fms_black_normal.h"
+#endif
+
+namespace fms::variance_swap {
+
+	// One expiry of a chain. Views of caller owned strikes, puts, and calls.
+	template<class X = double>
+	struct expiry {
+		X t, f;
+		std::span<const X> k, p, c;
+	};
+
+	template<class X = double>
+	class term_structure {
+		// strikes, -2 log k, and slope jumps
+		struct grid {
+			std::vector<X> k, g, w;
+		};
+		std::vector<grid> grids;
+		std::vector<expiry<X>> e;
+		std::vector<size_t> gi; // grid of each expiry
+		std::vector<size_t> ei; // 0, 1, ..., for parallel algorithms
+		std::vector<X> w;       // total variance
+	public:
+		term_structure()
+		{ }
+		term_structure(const term_structure&) = default;
+		term_structure& operator=(const term_structure&) = default;
+		~term_structure()
+		{ }
+
+		size_t size() const
+		{
+			return e.size();
+		}
+		X time(size_t j) const
+		{
+			return e[j].t;
+		}
+		// number of distinct strike grids
+		size_t grids_size() const
+		{
+			return grids.size();
+		}
+
+		// Expiries must be added in increasing order. Strikes are compared with existing grids.
+		term_structure& add(const expiry<X>& x)
+		{
+			ensure(x.t > 0 and x.f > 0);
+			ensure(e.empty() or x.t > e.back().t);
+			size_t n = x.k.size();
+			ensure(n >= 3 and n == x.p.size() and n == x.c.size());
+			ensure(x.k[0] > 0);
+
+			size_t i = grids.size();
+			while (i > 0 and !std::equal(x.k.begin(), x.k.end(), grids[i - 1].k.begin(), grids[i - 1].k.end())) {
+				--i;
+			}
+			if (i == 0) {
+				grid G;
+				G.k.assign(x.k.begin(), x.k.end());
+				G.g.resize(n);
+				for (size_t l = 0; l < n; ++l) {
+					G.g[l] = -2 * log(G.k[l]);
+				}
+				carr_madan::replication<X> R(x.k, std::span<const X>(G.g), x.k[0]);
+				G.w.assign(R.weight(), R.weight() + n);
+				grids.push_back(std::move(G));
+				i = grids.size();
+			}
+			gi.push_back(i - 1);
+			ei.push_back(e.size());
+			e.push_back(x);
+			w.push_back(std::numeric_limits<X>::quiet_NaN());
+
+			return *this;
+		}
+
+		// Fair total variance of expiry j
+		X value(size_t j) const
+		{
+			const auto& x = e[j];
+			const auto& G = grids[gi[j]];
+			size_t n = G.k.size();
+
+			X ga, ma;
+			carr_madan::tangent(std::span<const X>(&x.f, 1), std::span<const X>(G.k), std::span<const X>(G.g),
+				std::span<X>(&ga, 1), std::span<X>(&ma, 1));
+			X v = ga + 2 * log(x.f);
+			size_t ia = carr_madan::lower_bound(x.f, std::span<const X>(G.k));
+			for (size_t i = 1; i < ia and i < n - 1; ++i) {
+				v += G.w[i] * x.p[i];
+			}
+			for (size_t i = std::max<size_t>(ia, 1); i < n - 1; ++i) {
+				v += G.w[i] * x.c[i];
+			}
+
+			return v;
+		}
+
+		// Compute all expiries in parallel.
+		term_structure& compute()
+		{
+			std::for_each(std::execution::par, ei.begin(), ei.end(), [this](size_t j) { w[j] = value(j); });
+
+			return *this;
+		}
+
+		// Fair total variance w(t_j)
+		X total(size_t j) const
+		{
+			return w[j];
+		}
+		// Fair variance w(t_j)/t_j
+		X variance(size_t j) const
+		{
+			return w[j] / e[j].t;
+		}
+		// Forward variance over [t_{j-1}, t_j], t_{-1} = 0
+		X forward(size_t j) const
+		{
+			return j == 0 ? variance(0) : (w[j] - w[j - 1]) / (e[j].t - e[j - 1].t);
+		}
+		// Variance at t interpolating total variance linearly between expiries
+		// and extrapolating with constant forward variance.
+		X interpolate(X t) const
+		{
+			ensure(t > 0 and !e.empty());
+
+			auto j = std::lower_bound(e.begin(), e.end(), t, [](const auto& x, X t_) { return x.t < t_; }) - e.begin();
+			if (j == (ptrdiff_t)e.size()) {
+				--j;
+			}
+
+			return (w[j] + forward(j) * (t - e[j].t)) / t;
+		}
+	};
+
+#ifdef _DEBUG
+	inline int test()
+	{
+		// flat vol 0.2 then 0.3 after t = 0.5
+		double t[] = { 0.25, 0.5, 0.75, 1 };
+		double f[] = { 100, 101, 102, 103 };
+		auto sigma2 = [](double u) { return u <= 0.5 ? 0.04 * u : 0.02 + 0.09 * (u - 0.5); };
+		std::vector<double> k;
+		for (double k_ = 10; k_ <= 300; k_ += 1) {
+			k.push_back(k_);
+		}
+		size_t n = k.size();
+		std::vector<double> p(4 * n), c(4 * n);
+		for (size_t j = 0; j < 4; ++j) {
+			double s = sqrt(sigma2(t[j]));
+			for (size_t i = 0; i < n; ++i) {
+				p[j * n + i] = black::normal::put::value(f[j], s, k[i]);
+				c[j * n + i] = black::normal::call::value(f[j], s, k[i]);
+			}
+		}
+
+		term_structure<> ts;
+		for (size_t j = 0; j < 4; ++j) {
+			ts.add({ t[j], f[j], std::span<const double>(k),
+				std::span<const double>(p.data() + j * n, n), std::span<const double>(c.data() + j * n, n) });
+		}
+		ensure(ts.grids_size() == 1);
+		ts.compute();
+
+		for (size_t j = 0; j < 4; ++j) {
+			// same as carr_madan::value with separator f
+			std::vector<double> g(n);
+			for (size_t i = 0; i < n; ++i) {
+				g[i] = -2 * log(k[i] / f[j]);
+			}
+			double v = carr_madan::value(f[j], f[j], std::span(p.data() + j * n, n), std::span(c.data() + j * n, n),
+				std::span(k), std::span(g));
+			ensure(fabs(ts.total(j) - v) < 1e-12);
+			// piecewise linear -2 log k overstates total variance by about dk^2/(6 f^2)
+			ensure(fabs(ts.total(j) - sigma2(t[j])) < 3e-5);
+			ensure(ts.interpolate(t[j]) == ts.variance(j));
+		}
+		ensure(fabs(ts.forward(0) - 0.04) < 1e-4);
+		ensure(fabs(ts.forward(1) - 0.04) < 1e-5);
+		ensure(fabs(ts.forward(2) - 0.09) < 1e-5);
+		ensure(fabs(ts.forward(3) - 0.09) < 1e-5);
+		// interpolate and extrapolate
+		ensure(fabs(ts.interpolate(0.1) - 0.04) < 1e-4);
+		ensure(fabs(ts.interpolate(0.6) - sigma2(0.6) / 0.6) < 1e-4);
+		ensure(fabs(ts.interpolate(2.) - sigma2(2.) / 2) < 1e-4);
+
+		return 0;
+	}
+#endif // _DEBUG
+
+} // namespace fms::variance_swap
@@ -1,5 +1,6 @@
 // xll_binomial.cpp - Binomial model option pricing
 #include "../cpp/fms_binomial.h"
+#include "../cpp/fms_american.h"
 #include "xai.h"
 
 using namespace fms;
@@ -37,7 +38,43 @@ double WINAPI xll_binomial_european(double f, double s, double k, long n)
 	return v0;
 }
 
-// !!! Implement XLL.BINOMIAL.EUROPEANP based on XLL.BINOMIAL.EUROPEAN
+AddIn xai_binomial_europeanp(
+	Function(XLL_DOUBLE, "xll_binomial_europeanp", "XLL.BINOMIAL.EUROPEANP")
+	.Arguments({
+		Arg(XLL_DOUBLE, "f", "is the forward."),
+		Arg(XLL_DOUBLE, "s", "is the vol."),
+		Arg(XLL_DOUBLE, "p", "is the probability of an up move."),
+		Arg(XLL_DOUBLE, "k", "is the strike of a call (k > 0) or put (k < 0)."),
+		Arg(XLL_LONG, "n", "is the number of steps."),
+		})
+	.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp("Return value of skewed binomial European option.")
+);
+double WINAPI xll_binomial_europeanp(double f, double s, double p, double k, long n)
+{
+#pragma XLLEXPORT
+	double v0 = std::numeric_limits<double>::quiet_NaN();
+
+	try {
+		std::vector<double> v(n + 1);
+
+		if (k > 0) {
+			v0 = binomial::european::valuep(f, s, p, [=](double x) { return std::max(x - k, 0.); }, std::span(v));
+		}
+		else if (k < 0) {
+			v0 = binomial::european::valuep(f, s, p, [=](double x) { return std::max(-k - x, 0.); }, std::span(v));
+		}
+		else {
+			v0 = binomial::european::valuep(f, s, p, [](double x) { return x; }, std::span(v));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return v0;
+}
 
 AddIn xai_binomial_american(
 	Function(XLL_DOUBLE, "xll_binomial_american", "XLL.BINOMIAL.AMERICAN")
@@ -70,3 +107,108 @@ double WINAPI xll_binomial_american(double f, double s, double k, long n)
 
 	return v0;
 }
+
+AddIn xai_binomial_americanp(
+	Function(XLL_DOUBLE, "xll_binomial_americanp", "XLL.BINOMIAL.AMERICANP")
+	.Arguments({
+		Arg(XLL_DOUBLE, "f", "is the forward."),
+		Arg(XLL_DOUBLE, "s", "is the vol."),
+		Arg(XLL_DOUBLE, "p", "is the probability of an up move."),
+		Arg(XLL_DOUBLE, "k", "is the strike of a call (k > 0) or put (k < 0)."),
+		Arg(XLL_LONG, "n", "is the number of steps."),
+		})
+	.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp("Return value of skewed binomial American option.")
+);
+double WINAPI xll_binomial_americanp(double f, double s, double p, double k, long n)
+{
+#pragma XLLEXPORT
+	double v0 = std::numeric_limits<double>::quiet_NaN();
+
+	try {
+		std::vector<double> v(n + 1);
+
+		if (k > 0) {
+			v0 = binomial::american::valuep(f, s, p, [=](double x) { return std::max(x - k, 0.); }, std::span(v));
+		}
+		else if (k < 0) {
+			v0 = binomial::american::valuep(f, s, p, [=](double x) { return std::max(-k - x, 0.); }, std::span(v));
+		}
+		else {
+			v0 = binomial::american::valuep(f, s, p, [](double x) { return x; }, std::span(v));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return v0;
+}
+
+AddIn xai_binomial_american_implied(
+	Function(XLL_DOUBLE, "xll_binomial_american_implied", "XLL.BINOMIAL.AMERICAN.IMPLIED")
+	.Arguments({
+		Arg(XLL_DOUBLE, "f", "is the forward."),
+		Arg(XLL_DOUBLE, "p", "is the American option price."),
+		Arg(XLL_DOUBLE, "k", "is the strike of a call (k > 0) or put (k < 0)."),
+		Arg(XLL_LONG, "n", "is the number of steps."),
+		})
+	.Category(CATEGORY)
+	.FunctionHelp("Return vol implied by binomial American option price.")
+);
+double WINAPI xll_binomial_american_implied(double f, double p, double k, long n)
+{
+#pragma XLLEXPORT
+	double s = std::numeric_limits<double>::quiet_NaN();
+
+	try {
+		std::vector<double> v(n + 1), dv(n + 1);
+
+		s = american::implied(f, p, fabs(k), k > 0 ? 1. : -1., std::span(v), std::span(dv));
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return s;
+}
+
+AddIn xai_binomial_bermudan(
+	Function(XLL_DOUBLE, "xll_binomial_bermudan", "XLL.BINOMIAL.BERMUDAN")
+	.Arguments({
+		Arg(XLL_DOUBLE, "f", "is the forward."),
+		Arg(XLL_DOUBLE, "s", "is the vol."),
+		Arg(XLL_DOUBLE, "k", "is the strike of a call (k > 0) or put (k < 0)."),
+		Arg(XLL_FPX, "t", "is a sorted array of exercise times as a fraction of expiration."),
+		Arg(XLL_LONG, "n", "is the number of steps."),
+		})
+	.Uncalced()
+	.Category(CATEGORY)
+	.FunctionHelp("Return value of binomial Bermudan option.")
+);
+double WINAPI xll_binomial_bermudan(double f, double s, double k, _FPX* pt, long n)
+{
+#pragma XLLEXPORT
+	double v0 = std::numeric_limits<double>::quiet_NaN();
+
+	try {
+		std::vector<double> v(n + 1);
+		std::span<const double> t(pt->array, size(*pt));
+
+		if (k > 0) {
+			v0 = binomial::bermudan::value(f, s, [=](double x) { return std::max(x - k, 0.); }, t, std::span(v));
+		}
+		else if (k < 0) {
+			v0 = binomial::bermudan::value(f, s, [=](double x) { return std::max(-k - x, 0.); }, t, std::span(v));
+		}
+		else {
+			v0 = binomial::bermudan::value(f, s, [](double x) { return x; }, t, std::span(v));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return v0;
+}
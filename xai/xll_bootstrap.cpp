@@ -98,9 +98,7 @@ _FPX* WINAPI xll_pwflat_value(HANDLEX curve, _FPX* pt)
 	try {
 		handle<pwflat::curve<>> c(curve);
 		ensure(c);
-		for (unsigned i = 0; i < size(*pt); ++i) {
-			pt->array[i] = c->value(pt->array[i]);
-		}
+		c->value(std::span<const double>(pt->array, size(*pt)), std::span<double>(pt->array, size(*pt)));
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());
@@ -125,9 +123,7 @@ _FPX* WINAPI xll_pwflat_spot(HANDLEX curve, _FPX* pt)
 	try {
 		handle<pwflat::curve<>> c(curve);
 		ensure(c);
-		for (unsigned i = 0; i < size(*pt); ++i) {
-			pt->array[i] = c->spot(pt->array[i]);
-		}
+		c->spot(std::span<const double>(pt->array, size(*pt)), std::span<double>(pt->array, size(*pt)));
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());
@@ -152,9 +148,7 @@ _FPX* WINAPI xll_pwflat_discount(HANDLEX curve, _FPX* pt)
 	try {
 		handle<pwflat::curve<>> c(curve);
 		ensure(c);
-		for (unsigned i = 0; i < size(*pt); ++i) {
-			pt->array[i] = c->discount(pt->array[i]);
-		}
+		c->discount(std::span<const double>(pt->array, size(*pt)), std::span<double>(pt->array, size(*pt)));
 	}
 	catch (const std::exception& ex) {
 		XLL_ERROR(ex.what());